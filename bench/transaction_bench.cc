@@ -0,0 +1,419 @@
+#include "atom.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+
+// 每次迭代提交一个只改一次的事务, 带统计的版本看统计的开销
+template <typename Atom>
+static void BM_CommitThroughput(benchmark::State &state)
+{
+    Atom as(0);
+    typename Atom::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 1024;
+    as.setRetentionPolicy(policy);
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::modify, ++i);
+        as.endTransaction();
+    }
+    state.SetItemsProcessed(state.iterations());
+    benchmark::DoNotOptimize(as.get());
+}
+BENCHMARK_TEMPLATE(BM_CommitThroughput, AtomInt);
+BENCHMARK_TEMPLATE(BM_CommitThroughput, TransInterface<int, NoLog, TransStats>);
+
+static void BM_NestedBeginEndUndo(benchmark::State &state)
+{
+    AtomInt as(0);
+    AtomInt::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 64;
+    as.setRetentionPolicy(policy);
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, ++i);
+        for (int64_t depth = 0; depth < state.range(0); ++depth)
+        {
+            as.beginTransaction();
+            as.modify(AtomInt::ModifyType::modify, ++i);
+        }
+        for (int64_t depth = 0; depth < state.range(0); ++depth)
+            as.endTransaction();
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    benchmark::DoNotOptimize(as.get());
+}
+BENCHMARK(BM_NestedBeginEndUndo)->Arg(1)->Arg(4)->Arg(16);
+
+// 先提交range(0)个commit, 再测栈顶的undo+redo, 应该和历史长度无关
+static void BM_UndoRedoHistory(benchmark::State &state)
+{
+    AtomInt as(0);
+    for (int64_t i = 0; i < state.range(0); ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, static_cast<int>(i));
+        as.endTransaction();
+    }
+
+    for (auto _ : state)
+    {
+        as.undo();
+        as.redo();
+    }
+    benchmark::DoNotOptimize(as.get());
+}
+BENCHMARK(BM_UndoRedoHistory)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+// range(0)个元素, 在range(1)%的位置插入一个元素, 再在同一个位置删除, 两个commit
+static void BM_VectorInsertErase(benchmark::State &state)
+{
+    AtomIntVector as(state.range(0), 0);
+    AtomIntVector::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 64;
+    as.setRetentionPolicy(policy);
+
+    size_t offset = state.range(0) * state.range(1) / 100;
+    int i = 0;
+    for (auto _ : state)
+    {
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, offset, ++i);
+        as.endTransaction();
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Erase, offset);
+        as.endTransaction();
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    benchmark::DoNotOptimize(as.get().size());
+}
+BENCHMARK(BM_VectorInsertErase)->ArgsProduct({{1 << 10, 1 << 16, 1 << 20}, {0, 50, 100}});
+
+// 不限制历史, 看每个commit在历史里占多少字节(historyBytes的口径)
+template <typename Atom>
+static void BM_MemoryPerCommit(benchmark::State &state)
+{
+    Atom as(typename Atom::ValueType{});
+    std::mt19937 rng(1);
+    if constexpr (std::is_same_v<Atom, AtomInt>)
+    {
+        for (auto _ : state)
+        {
+            as.beginTransaction();
+            as.modify(Atom::ModifyType::modify, static_cast<int>(rng()));
+            as.endTransaction();
+        }
+    }
+    else
+    {
+        for (auto _ : state)
+        {
+            as.beginTransaction();
+            as.modify(Atom::ModifyType::Insert, rng() % (as.get().size() + 1), static_cast<int>(rng()));
+            as.endTransaction();
+        }
+    }
+    state.counters["bytes_per_commit"] =
+        benchmark::Counter(static_cast<double>(as.historyBytes()) / state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_MemoryPerCommit, AtomInt)->Iterations(100000);
+BENCHMARK_TEMPLATE(BM_MemoryPerCommit, AtomIntVector)->Iterations(20000);
+
+// 线程0是写线程, 每次迭代提交一个修改一个元素的事务, 其他线程读最新的已提交版本
+static void BM_SnapshotReadWrite(benchmark::State &state)
+{
+    static std::unique_ptr<AtomIntVector> as;
+    if (state.thread_index() == 0)
+    {
+        as = std::make_unique<AtomIntVector>(state.range(0), 0);
+        AtomIntVector::RetentionPolicy policy;
+        policy.maxUndoDepth_ = 64;
+        as->setRetentionPolicy(policy);
+        as->enableSnapshots();
+    }
+
+    int i = 0;
+    int64_t sum = 0;
+    for (auto _ : state)
+    {
+        if (state.thread_index() == 0)
+        {
+            size_t offset = i % state.range(0);
+            ++i;
+            as->beginTransaction();
+            as->modify(AtomIntVector::ModifyType::Modify, offset, i);
+            as->endTransaction();
+        }
+        else
+        {
+            auto version = as->snapshot();
+            sum += version->value_[i++ % version->value_.size()];
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    if (state.thread_index() == 0)
+        state.SetLabel("writer + readers");
+}
+BENCHMARK(BM_SnapshotReadWrite)->Arg(1 << 16)->Arg(1 << 20)->ThreadRange(2, 8)->UseRealTime();
+
+// 所有线程对同一个计数器做+1事务, 冲突时重试
+static void BM_ConcurrentIncrement(benchmark::State &state)
+{
+    static ConcurrentInt counter(0);
+    for (auto _ : state)
+        counter.transact([](auto &tx) { tx.modify(ConcurrentInt::ModifyType::modify, tx.get() + 1); });
+    if (state.thread_index() == 0)
+        state.counters["conflicts"] = counter.conflicts();
+}
+BENCHMARK(BM_ConcurrentIncrement)->ThreadRange(1, 32)->UseRealTime();
+
+// 在中间插入一个元素再undo, std::vector每次都要搬动后半段
+template <typename Atom>
+static void BM_MiddleInsertUndo(benchmark::State &state)
+{
+    Atom as(std::vector<int>(state.range(0), 0));
+    typename Atom::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 64;
+    as.setRetentionPolicy(policy);
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Insert, state.range(0) / 2, ++i);
+        as.endTransaction();
+        as.undo();
+    }
+    benchmark::DoNotOptimize(as.get().size());
+}
+BENCHMARK_TEMPLATE(BM_MiddleInsertUndo, AtomIntVector)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_MiddleInsertUndo, AtomIntPersistentVector)->Arg(1 << 16)->Arg(1 << 20);
+
+// 每个commit都要落盘: arg 0同步写+fsync, arg 1交给后台线程按group commit写
+static void BM_DurableCommit(benchmark::State &state)
+{
+    std::string path = "/tmp/transaction_bench_" + std::to_string(::getpid()) + ".txj";
+    std::remove(path.c_str());
+    {
+        AtomInt as(0);
+        typename AtomInt::RetentionPolicy policy;
+        policy.maxUndoDepth_ = 1024;
+        as.setRetentionPolicy(policy);
+        JournalOptions options;
+        options.snapshots_ = false;
+        options.syncEachCommit_ = state.range(0) == 0;
+        options.async_ = state.range(0) == 1;
+        as.openJournal(path, options);
+
+        int i = 0;
+        for (auto _ : state)
+        {
+            as.beginTransaction();
+            as.modify(AtomInt::ModifyType::modify, ++i);
+            as.endTransaction();
+        }
+        // 最后一批也要落盘才算数
+        as.durable().get();
+        state.SetItemsProcessed(state.iterations());
+    }
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_DurableCommit)->Arg(0)->Arg(1)->UseRealTime();
+
+// 元素是堆上的字符串: 每次迭代提交一个改一个元素的事务, 再undo/redo一遍
+static void BM_StringVectorEdit(benchmark::State &state)
+{
+    typedef TransInterface<std::vector<std::string>> Atom;
+    Atom as(std::vector<std::string>(1024, std::string(64, 'x')));
+    typename Atom::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 1024;
+    as.setRetentionPolicy(policy);
+
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        std::string val(64, static_cast<char>('a' + i % 26));
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Modify, i++ % 1024, std::move(val));
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StringVectorEdit);
+
+// 1M个元素里改1%之后整个提交: arg 0用Assign只记变了的段, arg 1用AssignRange记整个数组
+static void BM_AssignDiff(benchmark::State &state)
+{
+    const size_t size = 1 << 20;
+    std::vector<int> base(size);
+    AtomIntVector as(base);
+    AtomIntVector::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 1;
+    as.setRetentionPolicy(policy);
+    std::mt19937 rng(1);
+    std::vector<int> next = base;
+    size_t bytes = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (size_t i = 0; i < size / 100; ++i)
+            next[rng() % size] = static_cast<int>(rng());
+        state.ResumeTiming();
+
+        as.beginTransaction();
+        if (state.range(0) == 0)
+            as.modify(AtomIntVector::ModifyType::Assign, next);
+        else
+            as.modify(AtomIntVector::ModifyType::AssignRange, 0, next.begin(), next.end());
+        as.endTransaction();
+        bytes += as.historyBytes();
+        as.undo();
+        as.redo();
+    }
+    state.counters["history_bytes"] = benchmark::Counter(static_cast<double>(bytes) / state.iterations());
+}
+BENCHMARK(BM_AssignDiff)->Arg(0)->Arg(1);
+
+// 投机事务: 改几个元素之后放弃, arg 0用abortTransaction, arg 1用endTransaction再undo
+static void BM_SpeculativeAbort(benchmark::State &state)
+{
+    AtomIntVector as(1024, 0);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        as.beginTransaction();
+        for (int k = 0; k < 4; ++k)
+            as.modify(AtomIntVector::ModifyType::Modify, i++ % 1024, k);
+        if (state.range(0) == 0)
+        {
+            as.abortTransaction();
+        }
+        else
+        {
+            as.endTransaction();
+            as.undo();
+        }
+    }
+    state.counters["history_bytes"] = benchmark::Counter(static_cast<double>(as.historyBytes()));
+}
+BENCHMARK(BM_SpeculativeAbort)->Arg(0)->Arg(1);
+
+// 64个槽的配置表, 每个事务随机改16次(会重复改同一个槽), 再undo/redo一遍
+template <typename Atom>
+static void BM_FixedSlots(benchmark::State &state)
+{
+    typename Atom::ValueType init{};
+    if constexpr (std::is_same_v<Atom, AtomIntVector>)
+        init.resize(64);
+    Atom as(init);
+    typename Atom::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 1024;
+    as.setRetentionPolicy(policy);
+    std::mt19937 rng(1);
+    for (auto _ : state)
+    {
+        as.beginTransaction();
+        for (int i = 0; i < 16; ++i)
+            as.modify(Atom::ModifyType::Modify, rng() % 64, static_cast<int>(rng()));
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    state.counters["history_bytes"] = benchmark::Counter(static_cast<double>(as.historyBytes()));
+}
+BENCHMARK_TEMPLATE(BM_FixedSlots, AtomIntVector);
+BENCHMARK_TEMPLATE(BM_FixedSlots, AtomIntArray<64>);
+
+// 16MiB的存储区, 每个事务在8个热页里写256次64字节; arg 0按页存原内容, arg 1是按8字节槽记录的vector
+static void BM_PageWrite(benchmark::State &state)
+{
+    typedef TransInterface<std::vector<uint64_t>> WordVector;
+    const size_t size = 16 << 20;
+    const size_t pageSize = AtomInterface<ByteBuffer>::PageSize;
+    AtomByteBuffer pages(ByteBuffer{state.range(0) == 0 ? size : 0});
+    WordVector words(std::vector<uint64_t>(state.range(0) == 0 ? 0 : size / sizeof(uint64_t)));
+    pages.setRetentionPolicy({64});
+    words.setRetentionPolicy({64});
+    std::mt19937 rng(1);
+    uint64_t line[8] = {};
+    for (auto _ : state)
+    {
+        size_t hot = rng() % (size / pageSize - 8);
+        if (state.range(0) == 0)
+        {
+            pages.beginTransaction();
+            for (int i = 0; i < 256; ++i)
+            {
+                line[0] = i;
+                pages.modify(AtomByteBuffer::ModifyType::Write, (hot + i % 8) * pageSize + rng() % 64 * 64, line,
+                             sizeof(line));
+            }
+            pages.endTransaction();
+        }
+        else
+        {
+            words.beginTransaction();
+            for (int i = 0; i < 256; ++i)
+            {
+                size_t word = ((hot + i % 8) * pageSize + rng() % 64 * 64) / sizeof(uint64_t);
+                for (size_t k = 0; k < 8; ++k)
+                    words.modify(WordVector::ModifyType::Modify, word + k, k ? line[k] : static_cast<uint64_t>(i));
+            }
+            words.endTransaction();
+        }
+    }
+    state.counters["history_bytes"] =
+        benchmark::Counter(static_cast<double>(pages.historyBytes() + words.historyBytes()));
+}
+BENCHMARK(BM_PageWrite)->Arg(0)->Arg(1);
+
+// 每个线程写自己的分区, 每个事务改4个元素; arg 0是每个线程一个分片, arg 1是一个AtomIntVector加一把锁
+static void BM_PartitionedWriters(benchmark::State &state)
+{
+    static std::unique_ptr<ShardedIntVector> sharded;
+    static std::unique_ptr<AtomIntVector> single;
+    static std::mutex singleMutex;
+    const size_t partition = 1024;
+    if (state.thread_index() == 0)
+    {
+        sharded = std::make_unique<ShardedIntVector>(state.threads(), partition);
+        sharded->setRetentionPolicy({1024});
+        single = std::make_unique<AtomIntVector>(partition * state.threads(), 0);
+        single->setRetentionPolicy({1024});
+    }
+    size_t shard = state.thread_index();
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        if (state.range(0) == 0)
+        {
+            auto tx = sharded->beginTransaction(shard);
+            for (int k = 0; k < 4; ++k)
+                tx.modify(shard, ShardedIntVector::ModifyType::Modify, i++ % partition, k);
+            sharded->endTransaction(tx);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(singleMutex);
+            single->beginTransaction();
+            for (int k = 0; k < 4; ++k)
+                single->modify(AtomIntVector::ModifyType::Modify, shard * partition + i++ % partition, k);
+            single->endTransaction();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PartitionedWriters)->Arg(0)->Arg(1)->Threads(1)->Threads(4)->UseRealTime();
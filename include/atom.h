@@ -2,6 +2,20 @@
 #include "atomicIntegral.h"
 #include "transInterface.h"
 #include "atomicVector.h"
+#include "atomicArray.h"
+#include "atomicByteBuffer.h"
+#include "atomicPersistentVector.h"
+#include "atomicHashMap.h"
+#include "concurrentIntegral.h"
+#include "shardedVector.h"
+#include "transactionManager.h"
 
 typedef TransInterface<int> AtomInt;
-typedef TransInterface<std::vector<int>> AtomIntVector;
\ No newline at end of file
+typedef TransInterface<std::vector<int>> AtomIntVector;
+template <size_t N>
+using AtomIntArray = TransInterface<std::array<int, N>>;
+typedef TransInterface<PersistentVector<int>> AtomIntPersistentVector;
+typedef TransInterface<FlatHashMap<int, int>> AtomIntMap;
+typedef TransInterface<ByteBuffer> AtomByteBuffer;
+typedef ConcurrentIntegral<int> ConcurrentInt;
+typedef ShardedVector<int> ShardedIntVector;
\ No newline at end of file
@@ -0,0 +1,265 @@
+#pragma once
+#include "atomicInterface.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 能放下[0, N)里任意下标的最小无符号整数
+template <size_t N>
+using SlotIndex = std::conditional_t<
+    N <= UINT8_MAX + 1ull, uint8_t,
+    std::conditional_t<N <= UINT16_MAX + 1ull, uint16_t, std::conditional_t<N <= UINT32_MAX + 1ull, uint32_t, uint64_t>>>;
+
+// 定长数组, 配置表/每个核一个槽这种大小不变的状态
+// 只有改一个槽这一种修改, 记录里的下标按N选最小的整数类型; 一个事务里每个槽只存一次原值,
+// 合并之后按槽的顺序排好, undo就是对数组的一次顺序写回
+template <typename T, size_t N>
+class AtomInterface<std::array<T, N>>
+{
+  public:
+    typedef std::array<T, N> ValueType;
+    typedef ValueType Snapshot;
+    typedef SlotIndex<N> Offset;
+    enum class ModifyType : uint8_t
+    {
+        Fail,
+        Modify
+    };
+
+    static const char *stringfyModifyType(ModifyType type)
+    {
+        switch (type)
+        {
+        case ModifyType::Fail:
+            return "Fail";
+        case ModifyType::Modify:
+            return "Modify";
+        default:
+            return "Unknown";
+        }
+    }
+
+    // oldVal_是被覆盖的值, 新值在val_里; 这个事务已经存过原值的槽saved_为false, 只给journal用
+    struct ModifyRecord
+    {
+        Offset offset_;
+        ModifyType type_;
+        bool saved_ = false;
+        T oldVal_{};
+    };
+
+  public:
+    AtomInterface(ValueType val = {}) : val_(std::move(val))
+    {
+    }
+
+    void onBeginTransaction()
+    {
+        if (depth_ == scopes_.size())
+            scopes_.emplace_back();
+        else
+            scopes_[depth_].reset();
+        ++depth_;
+    }
+
+    // 子事务可能被单独undo, 它改过的槽外层要重新存原值
+    void onEndTransaction()
+    {
+        if (--depth_)
+            scopes_[depth_ - 1] &= ~scopes_[depth_];
+    }
+
+    // 值和val_[offset]交换, 换出来的值就是反向记录
+    ModifyRecord rollback(ModifyRecord &rec)
+    {
+        if (rec.type_ == ModifyType::Modify && rec.saved_)
+        {
+            using std::swap;
+            swap(val_[rec.offset_], rec.oldVal_);
+        }
+        return std::move(rec);
+    }
+
+    template <typename Input>
+        requires std::is_assignable_v<T &, Input &&>
+    ModifyRecord modify(ModifyType type, size_t offset, Input &&newVal)
+    {
+        if (type != ModifyType::Modify || offset >= N)
+            return ModifyRecord{0, ModifyType::Fail};
+
+        if (depth_ && scopes_[depth_ - 1].test(offset))
+        {
+            val_[offset] = std::forward<Input>(newVal);
+            return ModifyRecord{static_cast<Offset>(offset), ModifyType::Modify};
+        }
+        if (depth_)
+            scopes_[depth_ - 1].set(offset);
+        ModifyRecord rec{static_cast<Offset>(offset), ModifyType::Modify, true, std::move(val_[offset])};
+        val_[offset] = std::forward<Input>(newVal);
+        return rec;
+    }
+
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        std::ostringstream oss;
+        for (auto &&rec : records)
+        {
+            oss << "{offset=" << static_cast<size_t>(rec.offset_) << ", ModifyType=" << stringfyModifyType(rec.type_);
+            if (rec.type_ == ModifyType::Modify && rec.saved_)
+                oss << ", oldVal=" << rec.oldVal_;
+            oss << "} ";
+        }
+        return oss.str();
+    }
+
+    // 只留存了原值的记录, 同一个槽有好几条时(折叠进来的子事务)留最早的一条;
+    // 又改回原值的槽不需要记录, 剩下的按槽排序, undo时顺序写回
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        records.erase(std::remove_if(records.begin(), records.end(),
+                                     [](const ModifyRecord &rec) {
+                                         return rec.type_ != ModifyType::Modify || !rec.saved_;
+                                     }),
+                      records.end());
+        std::stable_sort(records.begin(), records.end(),
+                         [](const ModifyRecord &lhs, const ModifyRecord &rhs) { return lhs.offset_ < rhs.offset_; });
+        records.erase(std::unique(records.begin(), records.end(),
+                                  [](const ModifyRecord &lhs, const ModifyRecord &rhs) {
+                                      return lhs.offset_ == rhs.offset_;
+                                  }),
+                      records.end());
+        if constexpr (std::equality_comparable<T>)
+        {
+            records.erase(std::remove_if(records.begin(), records.end(),
+                                         [&](const ModifyRecord &rec) { return rec.oldVal_ == val_[rec.offset_]; }),
+                          records.end());
+        }
+    }
+
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+        requires Encodable<T>
+    {
+        writer.putByte(static_cast<uint8_t>(rec.type_));
+        if (rec.type_ == ModifyType::Modify)
+        {
+            writer.putVarint(rec.offset_);
+            encodeValue(writer, val_[rec.offset_]);
+        }
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+        requires Encodable<T>
+    {
+        ModifyType type = static_cast<ModifyType>(reader.getByte());
+        if (type != ModifyType::Modify)
+            return ModifyRecord{0, ModifyType::Fail};
+        size_t offset = reader.getVarint();
+        T newVal{};
+        decodeValue(reader, newVal);
+        if (!reader.ok())
+            return ModifyRecord{0, ModifyType::Fail};
+        return modify(type, offset, std::move(newVal));
+    }
+
+    // 合并过的记录按槽排好序, 下标存和上一条的差
+    static void packRecords(ByteWriter &writer, const RecordBuffer<ModifyRecord> &records)
+        requires Encodable<T>
+    {
+        writer.putVarint(records.size());
+        size_t prev = 0;
+        for (auto &&rec : records)
+        {
+            // 没存原值的记录rollback时什么都不做, 和Fail一样
+            bool saved = rec.type_ == ModifyType::Modify && rec.saved_;
+            writer.putByte(static_cast<uint8_t>(saved ? ModifyType::Modify : ModifyType::Fail));
+            writer.putZigzag(static_cast<int64_t>(rec.offset_ - prev));
+            prev = rec.offset_;
+            if (saved)
+                encodeValue(writer, rec.oldVal_);
+        }
+    }
+
+    static bool unpackRecords(ByteReader &reader, RecordBuffer<ModifyRecord> &records)
+        requires Encodable<T>
+    {
+        size_t count = reader.getVarint();
+        if (count > reader.remaining())
+            return false;
+        records.reserve(records.size() + count);
+        size_t prev = 0;
+        for (size_t i = 0; i < count && reader.ok(); ++i)
+        {
+            ModifyRecord &rec = records.emplace_back();
+            rec.type_ = static_cast<ModifyType>(reader.getByte());
+            prev += reader.getZigzag();
+            rec.offset_ = static_cast<Offset>(prev);
+            rec.saved_ = rec.type_ == ModifyType::Modify;
+            if (rec.saved_)
+                decodeValue(reader, rec.oldVal_);
+        }
+        return reader.ok();
+    }
+
+    size_t recordBytes(const ModifyRecord &) const
+    {
+        return sizeof(ModifyRecord);
+    }
+
+    void restore(const ValueType &val)
+        requires std::copy_constructible<T>
+    {
+        val_ = val;
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+        requires Encodable<T>
+    {
+        for (auto &&e : val_)
+            encodeValue(writer, e);
+    }
+
+    bool decodeSelf(ByteReader &reader)
+        requires Encodable<T>
+    {
+        ValueType val{};
+        for (auto &&e : val)
+            decodeValue(reader, e);
+        if (!reader.ok())
+            return false;
+        val_ = std::move(val);
+        return true;
+    }
+
+    Snapshot makeSnapshot(const Snapshot *) const
+        requires std::copy_constructible<T>
+    {
+        return val_;
+    }
+
+    std::string serialSelf() const
+    {
+        std::ostringstream oss;
+        oss << "{";
+        for (auto &&e : val_)
+            oss << e << " ";
+        oss << "} ";
+        return oss.str();
+    }
+
+    const ValueType &getRaw() const
+    {
+        return val_;
+    }
+
+  private:
+    ValueType val_;
+    std::vector<std::bitset<N>> scopes_; // 每层打开的事务里已经存过原值的槽, 下标是事务的深度
+    size_t depth_ = 0;
+};
@@ -0,0 +1,234 @@
+#pragma once
+#include "atomicInterface.h"
+#include "byteBuffer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <type_traits>
+#include <vector>
+
+// 大块的原始字节, 按页记录修改: 一个事务里第一次写到某一页时把整页原来的内容存进记录,
+// 之后再写这一页不用再存; rollback把存下的页和缓冲区里的页整页交换
+// 页是不是已经存过靠页上的事务戳, TransInterface在事务开始/结束时通知原子, 子事务有自己的戳
+template <>
+class AtomInterface<ByteBuffer>
+{
+  public:
+    typedef ByteBuffer ValueType;
+    typedef ValueType Snapshot;
+    static constexpr size_t PageSize = 4096;
+
+    enum class ModifyType : uint8_t
+    {
+        Fail,
+        Write
+    };
+
+    static const char *stringfyModifyType(ModifyType type)
+    {
+        switch (type)
+        {
+        case ModifyType::Fail:
+            return "Fail";
+        case ModifyType::Write:
+            return "Write";
+        default:
+            return "Unknown";
+        }
+    }
+
+    // offset_/length_是写的范围, 新内容在val_里; pages_是这次写第一次碰到的页,
+    // saved_按pages_的顺序存这些页原来的内容(最后一页可能不满一页)
+    struct ModifyRecord
+    {
+        size_t offset_;
+        size_t length_;
+        ModifyType type_;
+        std::vector<size_t> pages_{};
+        std::vector<std::byte> saved_{};
+    };
+
+    // 重复写已经存过的页只产生空记录, 只给journal用, endTransaction时合并掉
+    static constexpr bool CoalesceByDefault = true;
+
+  public:
+    AtomInterface(ValueType val = {}) : val_(std::move(val)), stamps_(pageCount(), 0)
+    {
+    }
+
+    void onBeginTransaction()
+    {
+        scopes_.push_back(nextScope_++);
+    }
+
+    // endTransaction和abortTransaction都会调用, 回到外层事务的戳
+    void onEndTransaction()
+    {
+        scopes_.pop_back();
+    }
+
+    // 存下的页和缓冲区里的页交换, 交换之后记录里存的就是redo要用的内容
+    ModifyRecord rollback(ModifyRecord &rec)
+    {
+        const std::byte *saved = rec.saved_.data();
+        for (size_t page : rec.pages_)
+        {
+            size_t len = pageLength(page);
+            std::byte *dst = val_.data() + page * PageSize;
+            std::swap_ranges(dst, dst + len, const_cast<std::byte *>(saved));
+            saved += len;
+        }
+        return std::move(rec);
+    }
+
+    ModifyRecord modify(ModifyType type, size_t offset, const void *data, size_t len)
+    {
+        if (type != ModifyType::Write || offset > val_.size() || len > val_.size() - offset)
+            return ModifyRecord{offset, len, ModifyType::Fail};
+
+        ModifyRecord rec{offset, len, ModifyType::Write};
+        if (len)
+        {
+            uint64_t scope = scopes_.empty() ? 0 : scopes_.back();
+            for (size_t page = offset / PageSize; page <= (offset + len - 1) / PageSize; ++page)
+            {
+                if (scope && stamps_[page] == scope)
+                    continue;
+                stamps_[page] = scope;
+                const std::byte *src = val_.data() + page * PageSize;
+                rec.pages_.push_back(page);
+                rec.saved_.insert(rec.saved_.end(), src, src + pageLength(page));
+            }
+            memcpy(val_.data() + offset, data, len);
+        }
+        return rec;
+    }
+
+    // 写一个平凡可拷贝的值
+    template <typename Pod>
+        requires std::is_trivially_copyable_v<Pod> && (!std::is_pointer_v<Pod>)
+    ModifyRecord modify(ModifyType type, size_t offset, const Pod &val)
+    {
+        return modify(type, offset, &val, sizeof(Pod));
+    }
+
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        std::ostringstream oss;
+        for (auto &&rec : records)
+        {
+            oss << "{offset=" << rec.offset_ << ", length=" << rec.length_
+                << ", ModifyType=" << stringfyModifyType(rec.type_) << ", pages=[";
+            for (size_t page : rec.pages_)
+                oss << page << " ";
+            oss << "]} ";
+        }
+        return oss.str();
+    }
+
+    // 只有存了页的记录rollback时有用, 其他的都去掉
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        records.erase(std::remove_if(records.begin(), records.end(),
+                                     [](const ModifyRecord &rec) { return rec.pages_.empty(); }),
+                      records.end());
+    }
+
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+    {
+        writer.putByte(static_cast<uint8_t>(rec.type_));
+        if (rec.type_ != ModifyType::Write)
+            return;
+        writer.putVarint(rec.offset_);
+        writer.putVarint(rec.length_);
+        writer.putBytes(val_.data() + rec.offset_, rec.length_);
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+    {
+        ModifyType type = static_cast<ModifyType>(reader.getByte());
+        if (type != ModifyType::Write)
+            return ModifyRecord{0, 0, ModifyType::Fail};
+        size_t offset = reader.getVarint();
+        size_t len = reader.getVarint();
+        if (len > reader.remaining())
+            return ModifyRecord{offset, len, ModifyType::Fail};
+        std::vector<std::byte> data(len);
+        reader.getBytes(data.data(), len);
+        if (!reader.ok())
+            return ModifyRecord{offset, len, ModifyType::Fail};
+        return modify(type, offset, data.data(), len);
+    }
+
+    size_t recordBytes(const ModifyRecord &rec) const
+    {
+        return sizeof(ModifyRecord) + rec.pages_.capacity() * sizeof(size_t) + rec.saved_.capacity();
+    }
+
+    // 大小一样时直接拷贝进去, 映射的文件还是映射着
+    void restore(const ValueType &val)
+    {
+        val_ = val;
+        resetStamps();
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+    {
+        writer.putVarint(val_.size());
+        writer.putBytes(val_.data(), val_.size());
+    }
+
+    bool decodeSelf(ByteReader &reader)
+    {
+        size_t size = reader.getVarint();
+        if (!reader.ok() || size > reader.remaining())
+            return false;
+        ValueType val(size);
+        reader.getBytes(val.data(), size);
+        if (!reader.ok())
+            return false;
+        val_ = val;
+        resetStamps();
+        return true;
+    }
+
+    // 整块拷贝到堆上, 只在enableSnapshots之后才会调用
+    Snapshot makeSnapshot(const Snapshot *) const
+    {
+        return val_;
+    }
+
+    std::string serialSelf() const
+    {
+        return "{size=" + std::to_string(val_.size()) + "}";
+    }
+
+    const ValueType &getRaw() const
+    {
+        return val_;
+    }
+
+  private:
+    size_t pageCount() const
+    {
+        return (val_.size() + PageSize - 1) / PageSize;
+    }
+
+    size_t pageLength(size_t page) const
+    {
+        return std::min(PageSize, val_.size() - page * PageSize);
+    }
+
+    // 大小可能变了, 已经存过的页都作废
+    void resetStamps()
+    {
+        stamps_.assign(pageCount(), 0);
+    }
+
+    ValueType val_;
+    std::vector<uint64_t> stamps_; // 每页最后一次存原内容的事务戳, 0 -> 没有
+    std::vector<uint64_t> scopes_; // 打开的事务的戳, 栈顶是当前事务
+    uint64_t nextScope_ = 1;
+};
@@ -0,0 +1,298 @@
+#pragma once
+#include "atomicInterface.h"
+#include "flatHashMap.h"
+#include <assert.h>
+#include <cstddef>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+template <typename K, typename V, typename Hash>
+class AtomInterface<FlatHashMap<K, V, Hash>>
+{
+  public:
+    typedef FlatHashMap<K, V, Hash> ValueType;
+    typedef ValueType Snapshot;
+    enum class ModifyType
+    {
+        Fail,
+        Insert, // key不能已经存在
+        Assign, // key必须已经存在
+        Erase   // key必须已经存在
+    };
+
+    const char *stringfyModifyType(ModifyType type) const
+    {
+        switch (type)
+        {
+        case ModifyType::Fail:
+            return "Fail";
+        case ModifyType::Insert:
+            return "Insert";
+        case ModifyType::Assign:
+            return "Assign";
+        case ModifyType::Erase:
+            return "Erase";
+        default:
+            return "Unknown";
+        }
+    }
+
+    // slot_/generation_: 记录产生时key所在的槽, 回滚时同一个generation里直接用这个槽
+    struct ModifyRecord
+    {
+        ModifyType type_;
+        K key_;
+        V oldVal_{};
+        V newVal_{};
+        size_t slot_ = ValueType::npos;
+        size_t generation_ = 0;
+    };
+
+  public:
+    AtomInterface() = default;
+
+    AtomInterface(ValueType val) : val_(std::move(val))
+    {
+    }
+
+    template <typename H, typename E, typename A>
+    AtomInterface(const std::unordered_map<K, V, H, E, A> &map) : val_(map)
+    {
+    }
+
+    ModifyRecord rollback(ModifyRecord &rec)
+    {
+        switch (rec.type_)
+        {
+        case ModifyType::Insert: {
+            size_t slot = slotOf(rec);
+            ModifyRecord newRec{ModifyType::Erase, rec.key_, val_.slots_[slot].second, rec.oldVal_, slot,
+                                val_.generation()};
+            val_.eraseSlot(slot);
+            return newRec;
+        }
+
+        case ModifyType::Erase: {
+            V val = rec.oldVal_;
+            size_t slot = rec.slot_;
+            if (!val_.placeAt(slot, rec.generation_, rec.key_, val))
+                slot = val_.insert(rec.key_, std::move(val));
+            return ModifyRecord{ModifyType::Insert, rec.key_, rec.newVal_, rec.oldVal_, slot, val_.generation()};
+        }
+
+        case ModifyType::Assign: {
+            size_t slot = slotOf(rec);
+            val_.slots_[slot].second = rec.oldVal_;
+            return ModifyRecord{ModifyType::Assign, rec.key_, rec.newVal_, rec.oldVal_, slot, val_.generation()};
+        }
+
+        default:
+            return ModifyRecord{ModifyType::Fail, rec.key_};
+        }
+    }
+
+    ModifyRecord modify(ModifyType type, const K &key)
+    {
+        if (type != ModifyType::Erase)
+            return ModifyRecord{ModifyType::Fail, key};
+        size_t slot = val_.findSlot(key);
+        if (slot == ValueType::npos)
+            return ModifyRecord{ModifyType::Fail, key};
+
+        ModifyRecord rec{ModifyType::Erase, key, val_.slots_[slot].second, V{}, slot, val_.generation()};
+        val_.eraseSlot(slot);
+        return rec;
+    }
+
+    template <typename Input>
+    ModifyRecord modify(ModifyType type, const K &key, Input &&newVal)
+    {
+        switch (type)
+        {
+        case ModifyType::Insert: {
+            size_t slot = val_.insert(key, newVal);
+            if (slot == ValueType::npos)
+                return ModifyRecord{ModifyType::Fail, key};
+            return ModifyRecord{ModifyType::Insert, key, V{}, val_.slots_[slot].second, slot, val_.generation()};
+        }
+
+        case ModifyType::Assign: {
+            size_t slot = val_.findSlot(key);
+            if (slot == ValueType::npos)
+                return ModifyRecord{ModifyType::Fail, key};
+            ModifyRecord rec{ModifyType::Assign, key, val_.slots_[slot].second, newVal, slot, val_.generation()};
+            val_.slots_[slot].second = rec.newVal_;
+            return rec;
+        }
+
+        default:
+            assert(false);
+        }
+        return ModifyRecord{ModifyType::Fail, key};
+    }
+
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        std::ostringstream oss;
+        for (auto &&rec : records)
+        {
+            oss << "{type=" << stringfyModifyType(rec.type_) << ", key=" << rec.key_ << ", oldVal=" << rec.oldVal_
+                << ", newVal=" << rec.newVal_ << "}";
+        }
+        return oss.str();
+    }
+
+    // 同一个key上的记录合并成一条, 放在第一次出现的位置:
+    // Insert+Assign -> Insert, Assign+Assign -> Assign, Assign+Erase -> Erase,
+    // Erase+Insert -> Assign, Insert+Erase -> 两条都去掉, Fail直接去掉
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        std::unordered_map<K, size_t, Hash> owners;
+        RecordBuffer<ModifyRecord> out;
+        std::vector<bool> dead;
+        for (auto &&rec : records)
+        {
+            if (rec.type_ == ModifyType::Fail)
+                continue;
+            auto iter = owners.find(rec.key_);
+            if (iter == owners.end() || dead[iter->second])
+            {
+                owners[rec.key_] = out.size();
+                out.emplace_back(std::move(rec));
+                dead.push_back(false);
+                continue;
+            }
+
+            ModifyRecord &owner = out[iter->second];
+            owner.newVal_ = std::move(rec.newVal_);
+            owner.slot_ = rec.slot_;
+            owner.generation_ = rec.generation_;
+            if (owner.type_ == ModifyType::Insert && rec.type_ == ModifyType::Erase)
+                dead[iter->second] = true;
+            else if (rec.type_ == ModifyType::Erase)
+                owner.type_ = ModifyType::Erase;
+            else if (owner.type_ == ModifyType::Erase)
+                owner.type_ = ModifyType::Assign;
+        }
+
+        records.clear();
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            if (!dead[i])
+                records.emplace_back(std::move(out[i]));
+        }
+    }
+
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+    {
+        writer.putByte(static_cast<uint8_t>(rec.type_));
+        encodeValue(writer, rec.key_);
+        if (rec.type_ == ModifyType::Insert || rec.type_ == ModifyType::Assign)
+            encodeValue(writer, rec.newVal_);
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+    {
+        ModifyType type = static_cast<ModifyType>(reader.getByte());
+        K key{};
+        decodeValue(reader, key);
+        if (!reader.ok())
+            return ModifyRecord{ModifyType::Fail, key};
+
+        switch (type)
+        {
+        case ModifyType::Insert:
+        case ModifyType::Assign: {
+            V newVal{};
+            decodeValue(reader, newVal);
+            if (reader.ok())
+                return modify(type, key, std::move(newVal));
+            break;
+        }
+
+        case ModifyType::Erase:
+            return modify(type, key);
+
+        default:
+            break;
+        }
+        return ModifyRecord{ModifyType::Fail, key};
+    }
+
+    size_t recordBytes(const ModifyRecord &) const
+    {
+        return sizeof(ModifyRecord);
+    }
+
+    void restore(const ValueType &val)
+    {
+        val_ = val;
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+    {
+        writer.putVarint(val_.size());
+        for (auto &&[key, val] : val_)
+        {
+            encodeValue(writer, key);
+            encodeValue(writer, val);
+        }
+    }
+
+    bool decodeSelf(ByteReader &reader)
+    {
+        size_t count = reader.getVarint();
+        if (!reader.ok() || count > reader.remaining())
+            return false;
+        ValueType val;
+        val.reserve(count);
+        for (size_t i = 0; i < count && reader.ok(); ++i)
+        {
+            K key{};
+            V mapped{};
+            decodeValue(reader, key);
+            decodeValue(reader, mapped);
+            val.insert(key, std::move(mapped));
+        }
+        if (!reader.ok())
+            return false;
+        val_ = std::move(val);
+        return true;
+    }
+
+    // 整张表拷贝一份
+    Snapshot makeSnapshot(const Snapshot *) const
+    {
+        return val_;
+    }
+
+    std::string serialSelf() const
+    {
+        std::ostringstream oss;
+        oss << "{";
+        for (auto &&[key, val] : val_)
+            oss << key << ":" << val << " ";
+        oss << "} ";
+        return oss.str();
+    }
+
+    const ValueType &getRaw() const
+    {
+        return val_;
+    }
+
+  private:
+    // 记录的槽在同一个generation里仍然是这个key就直接用, 否则重新查找
+    size_t slotOf(const ModifyRecord &rec) const
+    {
+        if (rec.generation_ == val_.generation() && rec.slot_ < val_.capacity() &&
+            !(val_.ctrl_[rec.slot_] & 0x80) && val_.slots_[rec.slot_].first == rec.key_)
+            return rec.slot_;
+        size_t slot = val_.findSlot(rec.key_);
+        assert(slot != ValueType::npos);
+        return slot;
+    }
+
+    ValueType val_;
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "atomicInterface.h"
 #include <cstddef>
+#include <cstdint>
 #include <sstream>
 #include <type_traits>
 
@@ -12,6 +13,7 @@ class AtomInterface<T>
 {
   public:
     typedef T ValueType;
+    typedef T Snapshot;
     enum class ModifyType
     {
         modify
@@ -23,9 +25,6 @@ class AtomInterface<T>
         {
         }
 
-        ModifyRecord(ModifyRecord &&rhs) : oldVal_(rhs.oldVal_), newVal_(rhs.newVal_)
-        {
-        }
         T oldVal_;
         T newVal_;
     };
@@ -50,7 +49,7 @@ class AtomInterface<T>
         return {oldVal, newVal};
     }
 
-    std::string serialModifyRecords(std::vector<ModifyRecord> &records) const
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records) const
     {
         std::ostringstream oss;
         for (auto &&rec : records)
@@ -58,6 +57,90 @@ class AtomInterface<T>
         return oss.str();
     }
 
+    // 只需要第一次的旧值和最后一次的新值, 最后回到原值时一条都不需要
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        if (records.empty())
+            return;
+        records.front().newVal_ = records.back().newVal_;
+        while (records.size() > 1)
+            records.pop_back();
+        if (records.front().oldVal_ == records.front().newVal_)
+            records.clear();
+    }
+
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+    {
+        encodeValue(writer, rec.newVal_);
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+    {
+        T newVal{};
+        decodeValue(reader, newVal);
+        return modify(ModifyType::modify, newVal);
+    }
+
+    // 连续修改时这次的旧值就是上次的新值, 都存和前一个值的差, 差按T的位宽回绕
+    static void packRecords(ByteWriter &writer, const RecordBuffer<ModifyRecord> &records)
+    {
+        writer.putVarint(records.size());
+        T prev{};
+        for (auto &&rec : records)
+        {
+            writer.putZigzag(delta(prev, rec.oldVal_));
+            writer.putZigzag(delta(rec.oldVal_, rec.newVal_));
+            prev = rec.newVal_;
+        }
+    }
+
+    static bool unpackRecords(ByteReader &reader, RecordBuffer<ModifyRecord> &records)
+    {
+        size_t count = reader.getVarint();
+        if (count > reader.remaining())
+            return false;
+        records.reserve(records.size() + count);
+        T prev{};
+        for (size_t i = 0; i < count && reader.ok(); ++i)
+        {
+            T oldVal = undelta(prev, reader.getZigzag());
+            T newVal = undelta(oldVal, reader.getZigzag());
+            records.emplace_back(oldVal, newVal);
+            prev = newVal;
+        }
+        return reader.ok();
+    }
+
+    size_t recordBytes(const ModifyRecord &) const
+    {
+        return sizeof(ModifyRecord);
+    }
+
+    void restore(const T &val)
+    {
+        val_ = val;
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+    {
+        encodeValue(writer, val_);
+    }
+
+    bool decodeSelf(ByteReader &reader)
+    {
+        T val{};
+        decodeValue(reader, val);
+        if (!reader.ok())
+            return false;
+        val_ = val;
+        return true;
+    }
+
+    Snapshot makeSnapshot(const Snapshot *) const
+    {
+        return val_;
+    }
+
     std::string serialSelf() const
     {
         return std::to_string(val_);
@@ -69,5 +152,17 @@ class AtomInterface<T>
     }
 
   private:
+    typedef std::make_unsigned_t<T> Bits;
+
+    static int64_t delta(T from, T to)
+    {
+        return static_cast<std::make_signed_t<T>>(static_cast<Bits>(static_cast<Bits>(to) - static_cast<Bits>(from)));
+    }
+
+    static T undelta(T from, int64_t delta)
+    {
+        return static_cast<T>(static_cast<Bits>(static_cast<Bits>(from) + static_cast<Bits>(delta)));
+    }
+
     T val_;
 };
\ No newline at end of file
@@ -1,4 +1,6 @@
 #pragma once
+#include "codec.h"
+#include "recordBuffer.h"
 #include <string>
 #include <vector>
 
@@ -7,17 +9,44 @@ class AtomInterface
 {
   public:
     typedef T ValueType;
+    class Snapshot; // 只读版本, 给读线程用
     enum class ModifyType;
-    class ModifyRecord; // must support move constructor
+    class ModifyRecord; // must support move constructor, checkout also needs copy
 
   public:
-    // rollback可以同时作用于undo/redo
+    // rollback可以同时作用于undo/redo, 返回反向记录; 之后rec不再使用, 里面的值可以直接移走
     ModifyRecord rollback(ModifyRecord &);
 
+    // TransInterface::modify的参数原样转发过来, 右值的新值应该移进去
     template <typename... Param>
-    ModifyRecord modify(ModifyType, Param...);
+    ModifyRecord modify(ModifyType, Param &&...);
 
-    std::string serialModifyRecords(std::vector<ModifyRecord> &) const;
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &) const;
+    size_t recordBytes(const ModifyRecord &) const; // memory held by one record, used by retention policy
+
+    // 合并同一个目标上的记录, 结果和原记录按顺序执行的效果一样
+    // 可选static constexpr bool CoalesceByDefault = true, TransInterface默认就在endTransaction时合并
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &) const;
+
+    // 可选, TransInterface在事务begin和end/abort之后通知原子, 嵌套事务成对调用
+    void onBeginTransaction();
+    void onEndTransaction();
+
+    // journal: 刚产生的记录编码成向前重放需要的内容, replayRecord解码后重新执行一遍, 返回新的记录
+    void encodeRecord(ByteWriter &, const ModifyRecord &) const;
+    ModifyRecord replayRecord(ByteReader &);
+
+    // 可选, 冷历史的紧凑编码: 一个commit的全部记录编码成一段字节, unpack原样还原
+    static void packRecords(ByteWriter &, const RecordBuffer<ModifyRecord> &);
+    static bool unpackRecords(ByteReader &, RecordBuffer<ModifyRecord> &);
+
+    // checkpoint: 直接恢复整个值, 以及journal snapshot里值的编码
+    void restore(const ValueType &);
+    void encodeSelf(ByteWriter &) const;
+    bool decodeSelf(ByteReader &);
+
+    // 当前值的只读版本, prev是上一次的结果, 可以和它共享没改过的部分
+    Snapshot makeSnapshot(const Snapshot *prev);
     std::string serialSelf() const;
 
     const ValueType &getRaw() const;
@@ -0,0 +1,327 @@
+#pragma once
+#include "atomicInterface.h"
+#include "atomicVector.h"
+#include "persistentVector.h"
+#include <assert.h>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <sstream>
+#include <type_traits>
+#include <vector>
+
+// 和AtomInterface<std::vector<T>>一样的记录和语义, 值换成PersistentVector
+// Insert/Erase是O(log n), range操作是O(k log n); snapshot直接拷贝根, O(1)
+template <typename T>
+class AtomInterface<PersistentVector<T>>
+{
+    typedef AtomInterface<std::vector<T>> VectorAtom;
+
+  public:
+    typedef PersistentVector<T> ValueType;
+    typedef ValueType Snapshot;
+    typedef typename VectorAtom::ModifyType ModifyType;
+    typedef typename VectorAtom::ModifyRecord ModifyRecord;
+    typedef typename VectorAtom::Range Range;
+
+  public:
+    template <typename... Args>
+    AtomInterface(Args... args) : val_(std::forward<Args>(args)...)
+    {
+    }
+
+    // 和AtomInterface<std::vector<T>>一样, rollback之后rec不再使用; 树里的值和别的版本共享, 只能拷贝出来
+    ModifyRecord rollback(ModifyRecord &rec)
+    {
+        switch (rec.type_)
+        {
+        case ModifyType::Modify: {
+            T cur = val_[rec.offset_];
+            val_.set(rec.offset_, std::move(rec.oldVal_));
+            rec.oldVal_ = std::move(cur);
+            return std::move(rec);
+        }
+
+        case ModifyType::Insert: {
+            ModifyRecord newRec{rec.offset_, ModifyType::Erase, val_[rec.offset_]};
+            val_.erase(rec.offset_);
+            return newRec;
+        }
+
+        case ModifyType::Erase:
+            val_.insert(rec.offset_, std::move(rec.oldVal_));
+            return ModifyRecord{rec.offset_, ModifyType::Insert};
+
+        case ModifyType::InsertRange:
+            return eraseRange(rec.offset_, rec.range_->count_);
+
+        case ModifyType::EraseRange: {
+            std::vector<T> &values = rec.range_->values_;
+            for (size_t i = 0; i < values.size(); ++i)
+                val_.insert(rec.offset_ + i, std::move(values[i]));
+            return VectorAtom::insertRangeRecord(rec.offset_, values.size());
+        }
+
+        case ModifyType::AssignRange: {
+            std::vector<T> &values = rec.range_->values_;
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                T cur = val_[rec.offset_ + i];
+                val_.set(rec.offset_ + i, std::move(values[i]));
+                values[i] = std::move(cur);
+            }
+            return std::move(rec);
+        }
+
+        default:
+            return ModifyRecord{rec.offset_, ModifyType::Fail};
+        }
+    }
+
+    // 只有Erase不带值
+    ModifyRecord modify(ModifyType type, size_t offset)
+    {
+        if (type != ModifyType::Erase || offset >= val_.size())
+            return ModifyRecord{offset, ModifyType::Fail};
+
+        ModifyRecord rec{offset, ModifyType::Erase, val_[offset]};
+        val_.erase(offset);
+        return rec;
+    }
+
+    ModifyRecord modify(ModifyType type, size_t offset, EraseCount count)
+    {
+        if (type != ModifyType::EraseRange)
+            return ModifyRecord{offset, ModifyType::Fail};
+        return eraseRange(offset, count.count_);
+    }
+
+    template <typename Input>
+        requires(!std::same_as<std::remove_cvref_t<Input>, EraseCount>)
+    ModifyRecord modify(ModifyType type, size_t offset, Input &&newVal)
+    {
+        if (offset > val_.size() || (type == ModifyType::Modify && offset == val_.size()))
+            return ModifyRecord{offset, ModifyType::Fail};
+
+        switch (type)
+        {
+        case ModifyType::Modify: {
+            ModifyRecord rec{offset, ModifyType::Modify, val_[offset]};
+            val_.set(offset, std::forward<Input>(newVal));
+            return rec;
+        }
+
+        case ModifyType::Insert:
+            val_.insert(offset, std::forward<Input>(newVal));
+            return ModifyRecord{offset, ModifyType::Insert};
+
+        default:
+            assert(false);
+        }
+        return ModifyRecord{};
+    }
+
+    // InsertRange/AssignRange, [first, last)整体插入或覆盖offset开始的一段, 只产生一条记录
+    template <typename InputIt>
+    ModifyRecord modify(ModifyType type, size_t offset, InputIt first, InputIt last)
+    {
+        switch (type)
+        {
+        case ModifyType::InsertRange: {
+            if (offset > val_.size())
+                return ModifyRecord{offset, ModifyType::Fail};
+            size_t count = 0;
+            for (; first != last; ++first, ++count)
+                val_.insert(offset + count, *first);
+            return VectorAtom::insertRangeRecord(offset, count);
+        }
+
+        case ModifyType::AssignRange: {
+            size_t count = std::distance(first, last);
+            if (offset > val_.size() || count > val_.size() - offset)
+                return ModifyRecord{offset, ModifyType::Fail};
+            return assignRange(offset, first, last);
+        }
+
+        default:
+            assert(false);
+        }
+        return ModifyRecord{};
+    }
+
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        return VectorAtom::serialModifyRecords(records);
+    }
+
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        VectorAtom::coalesceRecords(records, val_);
+    }
+
+    static void packRecords(ByteWriter &writer, const RecordBuffer<ModifyRecord> &records)
+    {
+        VectorAtom::packRecords(writer, records);
+    }
+
+    static bool unpackRecords(ByteReader &reader, RecordBuffer<ModifyRecord> &records)
+    {
+        return VectorAtom::unpackRecords(reader, records);
+    }
+
+    // 只编码重放需要的新值, 新值都还在val_里
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+    {
+        writer.putByte(static_cast<uint8_t>(rec.type_));
+        writer.putVarint(rec.offset_);
+        switch (rec.type_)
+        {
+        case ModifyType::Modify:
+        case ModifyType::Insert:
+            encodeValue(writer, val_[rec.offset_]);
+            break;
+
+        case ModifyType::InsertRange:
+        case ModifyType::AssignRange: {
+            size_t count = VectorAtom::rangeSize(rec);
+            writer.putVarint(count);
+            for (size_t i = 0; i < count; ++i)
+                encodeValue(writer, val_[rec.offset_ + i]);
+            break;
+        }
+
+        case ModifyType::EraseRange:
+            writer.putVarint(rec.range_->values_.size());
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+    {
+        ModifyType type = static_cast<ModifyType>(reader.getByte());
+        size_t offset = reader.getVarint();
+        switch (type)
+        {
+        case ModifyType::Modify:
+        case ModifyType::Insert: {
+            T newVal{};
+            decodeValue(reader, newVal);
+            if (reader.ok())
+                return modify(type, offset, std::move(newVal));
+            break;
+        }
+
+        case ModifyType::Erase:
+            return modify(type, offset);
+
+        case ModifyType::InsertRange:
+        case ModifyType::AssignRange: {
+            size_t count = reader.getVarint();
+            if (count > reader.remaining())
+                break;
+            std::vector<T> values(count);
+            for (auto &&e : values)
+                decodeValue(reader, e);
+            if (reader.ok())
+                return modify(type, offset, std::make_move_iterator(values.begin()),
+                              std::make_move_iterator(values.end()));
+            break;
+        }
+
+        case ModifyType::EraseRange:
+            return eraseRange(offset, reader.getVarint());
+
+        default:
+            break;
+        }
+        return ModifyRecord{offset, ModifyType::Fail};
+    }
+
+    size_t recordBytes(const ModifyRecord &rec) const
+    {
+        return VectorAtom::recordBytes(rec);
+    }
+
+    void restore(const ValueType &val)
+    {
+        val_ = val;
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+    {
+        writer.putVarint(val_.size());
+        val_.forEachChunk([&](const T *data, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+                encodeValue(writer, data[i]);
+        });
+    }
+
+    bool decodeSelf(ByteReader &reader)
+    {
+        size_t count = reader.getVarint();
+        if (!reader.ok() || count > reader.remaining())
+            return false;
+        std::vector<T> val(count);
+        for (auto &&e : val)
+            decodeValue(reader, e);
+        if (!reader.ok())
+            return false;
+        val_ = ValueType(val);
+        return true;
+    }
+
+    // 和val_共享整棵树, 之后的修改只复制路径上的节点
+    Snapshot makeSnapshot(const Snapshot *) const
+    {
+        return val_;
+    }
+
+    std::string serialSelf() const
+    {
+        std::ostringstream oss;
+        oss << "{";
+        for (auto &&e : val_)
+            oss << e << " ";
+        oss << "} ";
+        return oss.str();
+    }
+
+    const ValueType &getRaw() const
+    {
+        return val_;
+    }
+
+  private:
+    ModifyRecord eraseRange(size_t offset, size_t count)
+    {
+        if (offset > val_.size() || count > val_.size() - offset)
+            return ModifyRecord{offset, ModifyType::Fail};
+
+        ModifyRecord rec{offset, ModifyType::EraseRange, {}, Range{}};
+        rec.range_->values_.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            rec.range_->values_.emplace_back(val_[offset]);
+            val_.erase(offset);
+        }
+        return rec;
+    }
+
+    // 调用方保证范围合法, 返回的记录里是被覆盖的旧值
+    template <typename InputIt>
+    ModifyRecord assignRange(size_t offset, InputIt first, InputIt last)
+    {
+        ModifyRecord rec{offset, ModifyType::AssignRange, {}, Range{}};
+        for (size_t i = offset; first != last; ++first, ++i)
+        {
+            rec.range_->values_.emplace_back(val_[i]);
+            val_.set(i, *first);
+        }
+        return rec;
+    }
+
+    ValueType val_;
+};
@@ -0,0 +1,238 @@
+#pragma once
+#include "atomicInterface.h"
+#include <assert.h>
+#include <cstdlib>
+#include <optional>
+#include <sstream>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// 把几个不同类型的原子拼成一个, 共用外面TransInterface的一棵commit树
+// 每条记录是某一个成员的记录, variant的下标就是成员的下标
+template <typename... Ts>
+class AtomInterface<std::tuple<Ts...>>
+{
+  public:
+    typedef std::tuple<Ts...> ValueType;
+    typedef std::tuple<typename AtomInterface<Ts>::Snapshot...> Snapshot;
+
+    template <size_t I>
+    using Member = AtomInterface<std::tuple_element_t<I, ValueType>>;
+
+    // 修改哪个成员, 以及那个成员自己的ModifyType
+    struct ModifyType
+    {
+        size_t atom_;
+        std::variant<typename AtomInterface<Ts>::ModifyType...> type_;
+    };
+
+    typedef std::variant<typename AtomInterface<Ts>::ModifyRecord...> MemberRecord;
+
+    struct ModifyRecord
+    {
+        MemberRecord rec_;
+    };
+
+    template <size_t I>
+    static ModifyType on(typename Member<I>::ModifyType type)
+    {
+        return ModifyType{I, decltype(ModifyType::type_)(std::in_place_index<I>, type)};
+    }
+
+  public:
+    AtomInterface(Ts... vals) : atoms_(std::move(vals)...)
+    {
+    }
+
+    // 只转给需要知道事务边界的成员
+    void onBeginTransaction()
+    {
+        forEach([&](auto I) {
+            if constexpr (requires { std::get<I>(atoms_).onBeginTransaction(); })
+                std::get<I>(atoms_).onBeginTransaction();
+        });
+    }
+
+    void onEndTransaction()
+    {
+        forEach([&](auto I) {
+            if constexpr (requires { std::get<I>(atoms_).onEndTransaction(); })
+                std::get<I>(atoms_).onEndTransaction();
+        });
+    }
+
+    ModifyRecord rollback(ModifyRecord &rec)
+    {
+        std::optional<ModifyRecord> result;
+        visit(rec.rec_.index(), [&](auto I) {
+            result.emplace(wrap<I>(std::get<I>(atoms_).rollback(std::get<I>(rec.rec_))));
+        });
+        return std::move(*result);
+    }
+
+    template <typename... Args>
+    ModifyRecord modify(ModifyType type, Args &&...args)
+    {
+        return modifyMember<0>(type, std::forward<Args>(args)...);
+    }
+
+    std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        std::ostringstream oss;
+        for (auto &&rec : records)
+        {
+            visit(rec.rec_.index(), [&](auto I) {
+                RecordBuffer<typename Member<I>::ModifyRecord> one;
+                one.emplace_back(std::move(std::get<I>(rec.rec_)));
+                oss << "#" << I << std::get<I>(atoms_).serialModifyRecords(one);
+                rec.rec_.template emplace<I>(std::move(one.front()));
+            });
+        }
+        return oss.str();
+    }
+
+    size_t recordBytes(const ModifyRecord &rec) const
+    {
+        size_t bytes = 0;
+        visit(rec.rec_.index(), [&](auto I) {
+            bytes = sizeof(ModifyRecord) - sizeof(typename Member<I>::ModifyRecord) +
+                    std::get<I>(atoms_).recordBytes(std::get<I>(rec.rec_));
+        });
+        return bytes;
+    }
+
+    // 不同成员的记录互不影响, 按成员分开各自合并
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        RecordBuffer<ModifyRecord> out;
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (coalesceMember<I>(records, out), ...);
+        }(std::index_sequence_for<Ts...>{});
+        records.swap(out);
+    }
+
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+    {
+        writer.putVarint(rec.rec_.index());
+        visit(rec.rec_.index(), [&](auto I) { std::get<I>(atoms_).encodeRecord(writer, std::get<I>(rec.rec_)); });
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+    {
+        size_t index = reader.getVarint();
+        if (index >= sizeof...(Ts))
+        {
+            reader.fail();
+            index = 0;
+        }
+        std::optional<ModifyRecord> result;
+        visit(index, [&](auto I) {
+            result.emplace(wrap<I>(std::get<I>(atoms_).replayRecord(reader)));
+        });
+        return std::move(*result);
+    }
+
+    void restore(const ValueType &val)
+    {
+        forEach([&](auto I) { std::get<I>(atoms_).restore(std::get<I>(val)); });
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+    {
+        forEach([&](auto I) { std::get<I>(atoms_).encodeSelf(writer); });
+    }
+
+    bool decodeSelf(ByteReader &reader)
+    {
+        bool ok = true;
+        forEach([&](auto I) { ok = ok && std::get<I>(atoms_).decodeSelf(reader); });
+        return ok;
+    }
+
+    Snapshot makeSnapshot(const Snapshot *prev)
+    {
+        return [&]<size_t... I>(std::index_sequence<I...>) {
+            return Snapshot(std::get<I>(atoms_).makeSnapshot(prev ? &std::get<I>(*prev) : nullptr)...);
+        }(std::index_sequence_for<Ts...>{});
+    }
+
+    std::string serialSelf() const
+    {
+        std::ostringstream oss;
+        forEach([&](auto I) { oss << "#" << I << " " << std::get<I>(atoms_).serialSelf() << " "; });
+        return oss.str();
+    }
+
+    // 成员值的引用
+    std::tuple<const Ts &...> getRaw() const
+    {
+        return std::apply([](const auto &...atoms) { return std::tuple<const Ts &...>(atoms.getRaw()...); },
+                          atoms_);
+    }
+
+  private:
+    template <size_t I, typename Rec>
+    static ModifyRecord wrap(Rec &&rec)
+    {
+        return ModifyRecord{MemberRecord(std::in_place_index<I>, std::forward<Rec>(rec))};
+    }
+
+    // 成员的参数在编译期检查, TransactionManager::modify<I>已经static_assert过
+    template <size_t I, typename... Args>
+    ModifyRecord modifyMember(const ModifyType &type, Args &&...args)
+    {
+        if constexpr (I == sizeof...(Ts))
+        {
+            assert(false && "modify on an unknown atom");
+            std::abort();
+        }
+        else
+        {
+            if (type.atom_ != I)
+                return modifyMember<I + 1>(type, std::forward<Args>(args)...);
+            if constexpr (requires(Member<I> &atom, typename Member<I>::ModifyType t) {
+                              atom.modify(t, std::forward<Args>(args)...);
+                          })
+                return wrap<I>(std::get<I>(atoms_).modify(std::get<I>(type.type_), std::forward<Args>(args)...));
+            assert(false && "modify arguments do not match the atom");
+            std::abort();
+        }
+    }
+
+    // fn(std::integral_constant<size_t, index>)
+    template <typename Fn>
+    static void visit(size_t index, Fn &&fn)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            ((index == I ? (fn(std::integral_constant<size_t, I>{}), true) : false) || ...);
+        }(std::index_sequence_for<Ts...>{});
+    }
+
+    template <typename Fn>
+    static void forEach(Fn &&fn)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (fn(std::integral_constant<size_t, I>{}), ...);
+        }(std::index_sequence_for<Ts...>{});
+    }
+
+    template <size_t I>
+    void coalesceMember(RecordBuffer<ModifyRecord> &records, RecordBuffer<ModifyRecord> &out) const
+    {
+        RecordBuffer<typename Member<I>::ModifyRecord> member;
+        for (auto &&rec : records)
+        {
+            if (rec.rec_.index() == I)
+                member.emplace_back(std::move(std::get<I>(rec.rec_)));
+        }
+        if (member.empty())
+            return;
+        std::get<I>(atoms_).coalesceModifyRecords(member);
+        for (auto &&rec : member)
+            out.emplace_back(wrap<I>(std::move(rec)));
+    }
+
+    std::tuple<AtomInterface<Ts>...> atoms_;
+};
@@ -2,11 +2,26 @@
 
 #pragma once
 #include "atomicInterface.h"
+#include "simdDiff.h"
+#include <algorithm>
+#include <assert.h>
+#include <concepts>
 #include <cstddef>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+// modify(EraseRange, offset, EraseCount{n})删掉offset开始的n个元素, 和Modify/Insert的新值区分开
+struct EraseCount
+{
+    size_t count_;
+};
+
 template <typename T>
 class AtomInterface<std::vector<T>>
 {
@@ -17,10 +32,14 @@ class AtomInterface<std::vector<T>>
         Fail,
         Modify,
         Insert,
-        Erase
+        Erase,
+        InsertRange,
+        EraseRange,
+        AssignRange,
+        Assign // 整个值换掉, 产生的是AssignRange/InsertRange/EraseRange记录
     };
 
-    const char *stringfyModifyType(ModifyType type) const
+    static const char *stringfyModifyType(ModifyType type)
     {
         switch (type)
         {
@@ -32,71 +51,337 @@ class AtomInterface<std::vector<T>>
             return "Insert";
         case ModifyType::Erase:
             return "Erase";
+        case ModifyType::InsertRange:
+            return "InsertRange";
+        case ModifyType::EraseRange:
+            return "EraseRange";
+        case ModifyType::AssignRange:
+            return "AssignRange";
+        case ModifyType::Assign:
+            return "Assign";
         default:
             return "Unknown";
         }
     }
 
+    // range记录要放回去的一整块, 放在堆上, 单个元素的记录只带一个空指针
+    struct Range
+    {
+        std::vector<T> values_; // EraseRange/AssignRange删掉/覆盖的旧值
+        size_t count_ = 0;      // InsertRange插入的个数
+    };
+
+    // 独占一个Range, 拷贝记录时整块深拷贝
+    class RangePtr
+    {
+      public:
+        RangePtr() = default;
+
+        RangePtr(Range range) : range_(std::make_unique<Range>(std::move(range)))
+        {
+        }
+
+        RangePtr(RangePtr &&) noexcept = default;
+        RangePtr &operator=(RangePtr &&) noexcept = default;
+
+        RangePtr(const RangePtr &rhs)
+            requires std::copy_constructible<T>
+            : range_(rhs.range_ ? std::make_unique<Range>(*rhs.range_) : nullptr)
+        {
+        }
+
+        RangePtr &operator=(const RangePtr &rhs)
+            requires std::copy_constructible<T>
+        {
+            range_ = rhs.range_ ? std::make_unique<Range>(*rhs.range_) : nullptr;
+            return *this;
+        }
+
+        Range *operator->() const
+        {
+            return range_.get();
+        }
+
+        explicit operator bool() const
+        {
+            return range_ != nullptr;
+        }
+
+      private:
+        std::unique_ptr<Range> range_;
+    };
+
+    // 记录只存rollback要放回去的值, 新值都在val_里:
+    // Modify/Erase -> oldVal_是被覆盖/删掉的值, Insert -> 不存值, 三种都没有range_
+    // InsertRange/EraseRange/AssignRange -> range_
     struct ModifyRecord
     {
         size_t offset_;
         ModifyType type_;
-        T oldVal_;
-        T newVal_;
+        T oldVal_{};
+        RangePtr range_{};
+    };
+
+    // 只读的分块拷贝, 相邻两个版本共享没有改过的块
+    class Snapshot
+    {
+      public:
+        typedef std::shared_ptr<const std::vector<T>> Chunk;
+
+        size_t size() const
+        {
+            return ends_.empty() ? 0 : ends_.back();
+        }
+
+        bool empty() const
+        {
+            return size() == 0;
+        }
+
+        const T &operator[](size_t index) const
+        {
+            size_t chunk = std::upper_bound(ends_.begin(), ends_.end(), index) - ends_.begin();
+            return (*chunks_[chunk])[index - chunkBegin(chunk)];
+        }
+
+        const std::vector<Chunk> &chunks() const
+        {
+            return chunks_;
+        }
+
+        ValueType toVector() const
+        {
+            ValueType val;
+            val.reserve(size());
+            for (auto &&chunk : chunks_)
+                val.insert(val.end(), chunk->begin(), chunk->end());
+            return val;
+        }
+
+        bool operator==(const ValueType &rhs) const
+        {
+            if (size() != rhs.size())
+                return false;
+            auto iter = rhs.begin();
+            for (auto &&chunk : chunks_)
+            {
+                if (!std::equal(chunk->begin(), chunk->end(), iter))
+                    return false;
+                iter += chunk->size();
+            }
+            return true;
+        }
+
+      private:
+        friend class AtomInterface;
+
+        size_t chunkBegin(size_t chunk) const
+        {
+            return chunk ? ends_[chunk - 1] : 0;
+        }
+
+        void append(Chunk chunk)
+        {
+            ends_.emplace_back(size() + chunk->size());
+            chunks_.emplace_back(std::move(chunk));
+        }
+
+        std::vector<Chunk> chunks_;
+        std::vector<size_t> ends_; // prefix sums of chunk sizes
     };
 
+    static constexpr size_t SnapshotChunkSize = std::max<size_t>(16, 4096 / sizeof(T));
+
   public:
     template <typename... Args>
     AtomInterface(Args... args) : val_(std::forward<Args>(args)...)
     {
     }
 
+    // 值从rec移进val_, val_里被换出来的值移进返回的反向记录, 之后rec不再使用
     ModifyRecord rollback(ModifyRecord &rec)
     {
         switch (rec.type_)
         {
         case ModifyType::Modify:
-            val_[rec.offset_] = rec.oldVal_;
-            return ModifyRecord{rec.offset_, ModifyType::Modify, rec.newVal_, rec.oldVal_};
+            std::swap(val_[rec.offset_], rec.oldVal_);
+            markDirty(rec.offset_, 1);
+            return std::move(rec);
 
-        case ModifyType::Insert:
+        case ModifyType::Insert: {
+            ModifyRecord newRec{rec.offset_, ModifyType::Erase, std::move(val_[rec.offset_])};
             val_.erase(val_.begin() + rec.offset_);
-            return ModifyRecord{rec.offset_, ModifyType::Erase, rec.newVal_, rec.oldVal_};
+            markDirty(rec.offset_, 0);
+            return newRec;
+        }
 
         case ModifyType::Erase:
-            val_.insert(val_.begin() + rec.offset_, rec.oldVal_);
-            return ModifyRecord{rec.offset_, ModifyType::Insert, rec.newVal_, rec.oldVal_};
+            val_.emplace(val_.begin() + rec.offset_, std::move(rec.oldVal_));
+            markDirty(rec.offset_, 1);
+            return ModifyRecord{rec.offset_, ModifyType::Insert};
+
+        case ModifyType::InsertRange:
+            return eraseRange(rec.offset_, rec.range_->count_);
+
+        case ModifyType::EraseRange: {
+            std::vector<T> &values = rec.range_->values_;
+            size_t count = values.size();
+            val_.insert(val_.begin() + rec.offset_, std::make_move_iterator(values.begin()),
+                        std::make_move_iterator(values.end()));
+            markDirty(rec.offset_, count);
+            return insertRangeRecord(rec.offset_, count);
+        }
+
+        case ModifyType::AssignRange: {
+            std::vector<T> &values = rec.range_->values_;
+            std::swap_ranges(values.begin(), values.end(), val_.begin() + rec.offset_);
+            markDirty(rec.offset_, values.size());
+            return std::move(rec);
+        }
 
         default:
-            return ModifyRecord{};
+            return ModifyRecord{rec.offset_, ModifyType::Fail};
         }
-        return ModifyRecord{};
     }
 
     ModifyRecord modify(ModifyType type, size_t offset)
     {
-        T oldVal = val_[offset];
+        if (offset >= val_.size())
+            return ModifyRecord{offset, ModifyType::Fail};
+
+        ModifyRecord rec{offset, ModifyType::Erase, std::move(val_[offset])};
         val_.erase(val_.begin() + offset);
-        return ModifyRecord{offset, ModifyType::Erase, oldVal, oldVal};
+        markDirty(offset, 0);
+        return rec;
+    }
+
+    ModifyRecord modify(ModifyType type, size_t offset, EraseCount count)
+    {
+        if (type != ModifyType::EraseRange)
+            return ModifyRecord{offset, ModifyType::Fail};
+        return eraseRange(offset, count.count_);
     }
 
+    // Modify/Insert, newVal直接转发进val_, 右值不拷贝
     template <typename Input>
+        requires(!std::same_as<std::remove_cvref_t<Input>, ValueType> &&
+                 !std::same_as<std::remove_cvref_t<Input>, EraseCount> && std::is_constructible_v<T, Input &&>)
     ModifyRecord modify(ModifyType type, size_t offset, Input &&newVal)
     {
-        if (offset > val_.size())
-            return ModifyRecord{offset, ModifyType::Fail, newVal, newVal};
+        if (offset > val_.size() || (type == ModifyType::Modify && offset == val_.size()))
+            return ModifyRecord{offset, ModifyType::Fail};
 
         switch (type)
         {
         case ModifyType::Modify: {
-            T oldVal = val_[offset];
-            val_[offset] = newVal;
-            return ModifyRecord{offset, ModifyType::Modify, oldVal, newVal};
+            ModifyRecord rec{offset, ModifyType::Modify, std::move(val_[offset])};
+            val_[offset] = std::forward<Input>(newVal);
+            markDirty(offset, 1);
+            return rec;
         }
 
         case ModifyType::Insert:
-            val_.insert(val_.begin() + offset, newVal);
-            return ModifyRecord{offset, ModifyType::Insert, newVal, newVal};
+            val_.emplace(val_.begin() + offset, std::forward<Input>(newVal));
+            markDirty(offset, 1);
+            return ModifyRecord{offset, ModifyType::Insert};
+
+        default:
+            break;
+        }
+        assert(false);
+        return ModifyRecord{};
+    }
+
+    // Assign, val_整个换成newVal, 只有变了的段各产生一条AssignRange, 长度的变化是末尾的InsertRange/EraseRange
+    // 元素能按字节比较时用mismatchBytes找变了的地方; 相隔不到MergeGap个元素的两段合成一条, 省掉一条记录的开销
+    template <typename Value>
+        requires std::same_as<std::remove_cvref_t<Value>, ValueType>
+    std::vector<ModifyRecord> modify(ModifyType type, Value &&newVal)
+    {
+        assert(type == ModifyType::Assign);
+        constexpr size_t MergeGap = std::max<size_t>(1, sizeof(ModifyRecord) / sizeof(T));
+        auto take = [&](size_t i) -> decltype(auto) {
+            if constexpr (std::is_rvalue_reference_v<Value &&>)
+                return std::move(newVal[i]);
+            else
+                return std::as_const(newVal[i]);
+        };
+
+        std::vector<ModifyRecord> records;
+        size_t common = std::min(val_.size(), newVal.size());
+        size_t begin = nextDiff(newVal, 0, common);
+        while (begin < common)
+        {
+            size_t end = begin + 1;
+            for (;;)
+            {
+                while (end < common && nextDiff(newVal, end, end + 1) == end)
+                    ++end;
+                size_t limit = std::min(common, end + MergeGap);
+                size_t next = nextDiff(newVal, end, limit);
+                if (next == limit)
+                    break;
+                end = next + 1;
+            }
+
+            ModifyRecord &rec = records.emplace_back(ModifyRecord{begin, ModifyType::AssignRange, {}, Range{}});
+            rec.range_->values_.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i)
+            {
+                rec.range_->values_.emplace_back(std::move(val_[i]));
+                val_[i] = take(i);
+            }
+            markDirty(begin, end - begin);
+            begin = nextDiff(newVal, end, common);
+        }
+
+        if (newVal.size() > common)
+        {
+            size_t count = newVal.size() - common;
+            val_.reserve(newVal.size());
+            for (size_t i = common; i < newVal.size(); ++i)
+                val_.emplace_back(take(i));
+            markDirty(common, count);
+            records.emplace_back(insertRangeRecord(common, count));
+        }
+        else if (val_.size() > common)
+        {
+            records.emplace_back(eraseRange(common, val_.size() - common));
+        }
+        return records;
+    }
+
+    // InsertRange/AssignRange, [first, last)整体插入或覆盖offset开始的一段, 只产生一条记录
+    // 传move_iterator时元素移进val_
+    template <typename InputIt>
+    ModifyRecord modify(ModifyType type, size_t offset, InputIt first, InputIt last)
+    {
+        switch (type)
+        {
+        case ModifyType::InsertRange: {
+            if (offset > val_.size())
+                return ModifyRecord{offset, ModifyType::Fail};
+            size_t size = val_.size();
+            val_.insert(val_.begin() + offset, first, last);
+            size_t count = val_.size() - size;
+            markDirty(offset, count);
+            return insertRangeRecord(offset, count);
+        }
+
+        case ModifyType::AssignRange: {
+            size_t count = std::distance(first, last);
+            if (offset > val_.size() || count > val_.size() - offset)
+                return ModifyRecord{offset, ModifyType::Fail};
+            ModifyRecord rec{offset, ModifyType::AssignRange, {}, Range{}};
+            rec.range_->values_.reserve(count);
+            for (auto dest = val_.begin() + offset; first != last; ++first, ++dest)
+            {
+                rec.range_->values_.emplace_back(std::move(*dest));
+                *dest = *first;
+            }
+            markDirty(offset, count);
+            return rec;
+        }
 
         default:
             assert(false);
@@ -104,15 +389,338 @@ class AtomInterface<std::vector<T>>
         return ModifyRecord{};
     }
 
-    std::string serialModifyRecords(std::vector<ModifyRecord> &records) const
+    static std::string serialModifyRecords(RecordBuffer<ModifyRecord> &records)
     {
         std::ostringstream oss;
         for (auto &&rec : records)
-            oss << "{offset=" << rec.offset_ << ", ModifyType=" << stringfyModifyType(rec.type_)
-                << ", oldVal=" << rec.oldVal_ << ", newVal=" << rec.newVal_ << "} ";
+        {
+            oss << "{offset=" << rec.offset_ << ", ModifyType=" << stringfyModifyType(rec.type_);
+            switch (rec.type_)
+            {
+            case ModifyType::Modify:
+            case ModifyType::Erase:
+                oss << ", oldVal=" << rec.oldVal_;
+                break;
+
+            case ModifyType::InsertRange:
+                oss << ", count=" << rec.range_->count_;
+                break;
+
+            case ModifyType::EraseRange:
+            case ModifyType::AssignRange:
+                oss << ", values=[";
+                for (auto &&e : rec.range_->values_)
+                    oss << e << " ";
+                oss << "]";
+                break;
+
+            default:
+                break;
+            }
+            oss << "} ";
+        }
         return oss.str();
     }
 
+    void coalesceModifyRecords(RecordBuffer<ModifyRecord> &records) const
+    {
+        coalesceRecords(records, val_);
+    }
+
+    // 同一个元素上的Modify只留第一条(最早的旧值), 插入的元素不需要Modify记录;
+    // Insert/Erase之后按新的偏移量继续合并, range记录之前的不再合并, Fail记录直接丢掉
+    // current是records全部执行完之后的值, 最后又等于旧值的Modify也丢掉
+    template <typename Value>
+    static void coalesceRecords(RecordBuffer<ModifyRecord> &records, const Value &current)
+    {
+        RecordBuffer<ModifyRecord> out;
+        out.reserve(records.size());
+        std::map<size_t, size_t> owners; // 元素当前的offset -> out里第一条写这个元素的记录
+        for (auto &rec : records)
+        {
+            switch (rec.type_)
+            {
+            case ModifyType::Fail:
+                continue;
+
+            case ModifyType::Modify:
+                if (owners.count(rec.offset_))
+                    continue;
+                owners.emplace(rec.offset_, out.size());
+                break;
+
+            case ModifyType::Insert:
+                shiftOwners(owners, rec.offset_, 1);
+                owners.emplace(rec.offset_, out.size());
+                break;
+
+            case ModifyType::Erase: {
+                // 刚插入又删掉, 中间没有别的记录时两条都不要
+                auto owner = owners.find(rec.offset_);
+                bool cancel = owner != owners.end() && owner->second + 1 == out.size() &&
+                              out.back().type_ == ModifyType::Insert;
+                if (owner != owners.end())
+                    owners.erase(owner);
+                shiftOwners(owners, rec.offset_ + 1, -1);
+                if (cancel)
+                {
+                    out.pop_back();
+                    continue;
+                }
+                break;
+            }
+
+            default:
+                owners.clear();
+                break;
+            }
+            out.emplace_back(std::move(rec));
+        }
+        // 改了又改回原值的元素不需要记录
+        if constexpr (std::equality_comparable<T>)
+        {
+            std::vector<bool> unchanged(out.size());
+            for (auto &&[offset, index] : owners)
+                unchanged[index] = out[index].type_ == ModifyType::Modify && out[index].oldVal_ == current[offset];
+            size_t index = 0;
+            out.erase(std::remove_if(out.begin(), out.end(), [&](const ModifyRecord &) { return unchanged[index++]; }),
+                      out.end());
+        }
+        records.swap(out);
+    }
+
+    // 只编码重放需要的新值, 新值都还在val_里
+    void encodeRecord(ByteWriter &writer, const ModifyRecord &rec) const
+        requires Encodable<T>
+    {
+        writer.putByte(static_cast<uint8_t>(rec.type_));
+        writer.putVarint(rec.offset_);
+        switch (rec.type_)
+        {
+        case ModifyType::Modify:
+        case ModifyType::Insert:
+            encodeValue(writer, val_[rec.offset_]);
+            break;
+
+        case ModifyType::InsertRange:
+        case ModifyType::AssignRange: {
+            size_t count = rangeSize(rec);
+            writer.putVarint(count);
+            for (size_t i = 0; i < count; ++i)
+                encodeValue(writer, val_[rec.offset_ + i]);
+            break;
+        }
+
+        case ModifyType::EraseRange:
+            writer.putVarint(rec.range_->values_.size());
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    ModifyRecord replayRecord(ByteReader &reader)
+        requires Encodable<T>
+    {
+        ModifyType type = static_cast<ModifyType>(reader.getByte());
+        size_t offset = reader.getVarint();
+        switch (type)
+        {
+        case ModifyType::Modify:
+        case ModifyType::Insert: {
+            T newVal{};
+            decodeValue(reader, newVal);
+            if (reader.ok())
+                return modify(type, offset, std::move(newVal));
+            break;
+        }
+
+        case ModifyType::Erase:
+            return modify(type, offset);
+
+        case ModifyType::InsertRange:
+        case ModifyType::AssignRange: {
+            size_t count = reader.getVarint();
+            if (count > reader.remaining())
+                break;
+            std::vector<T> values(count);
+            for (auto &&e : values)
+                decodeValue(reader, e);
+            if (reader.ok())
+                return modify(type, offset, std::make_move_iterator(values.begin()),
+                              std::make_move_iterator(values.end()));
+            break;
+        }
+
+        case ModifyType::EraseRange:
+            return eraseRange(offset, reader.getVarint());
+
+        default:
+            break;
+        }
+        return ModifyRecord{offset, ModifyType::Fail};
+    }
+
+    // offset存和上一条记录的差, 每条记录只存它本来就有的值
+    static void packRecords(ByteWriter &writer, const RecordBuffer<ModifyRecord> &records)
+        requires Encodable<T>
+    {
+        writer.putVarint(records.size());
+        size_t prev = 0;
+        for (auto &&rec : records)
+        {
+            writer.putByte(static_cast<uint8_t>(rec.type_));
+            writer.putZigzag(static_cast<int64_t>(rec.offset_ - prev));
+            prev = rec.offset_;
+            switch (rec.type_)
+            {
+            case ModifyType::Modify:
+            case ModifyType::Erase:
+                encodeValue(writer, rec.oldVal_);
+                break;
+
+            case ModifyType::InsertRange:
+                writer.putVarint(rec.range_->count_);
+                break;
+
+            case ModifyType::EraseRange:
+            case ModifyType::AssignRange:
+                writer.putVarint(rec.range_->values_.size());
+                for (auto &&e : rec.range_->values_)
+                    encodeValue(writer, e);
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    static bool unpackRecords(ByteReader &reader, RecordBuffer<ModifyRecord> &records)
+        requires Encodable<T>
+    {
+        size_t count = reader.getVarint();
+        if (count > reader.remaining())
+            return false;
+        records.reserve(records.size() + count);
+        size_t prev = 0;
+        for (size_t i = 0; i < count && reader.ok(); ++i)
+        {
+            ModifyRecord &rec = records.emplace_back();
+            rec.type_ = static_cast<ModifyType>(reader.getByte());
+            rec.offset_ = prev + reader.getZigzag();
+            prev = rec.offset_;
+            switch (rec.type_)
+            {
+            case ModifyType::Modify:
+            case ModifyType::Erase:
+                decodeValue(reader, rec.oldVal_);
+                break;
+
+            case ModifyType::InsertRange:
+                rec.range_ = Range{{}, reader.getVarint()};
+                break;
+
+            case ModifyType::EraseRange:
+            case ModifyType::AssignRange: {
+                size_t size = reader.getVarint();
+                if (size > reader.remaining())
+                    return false;
+                rec.range_ = Range{std::vector<T>(size)};
+                for (auto &&e : rec.range_->values_)
+                    decodeValue(reader, e);
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+        return reader.ok();
+    }
+
+    static size_t recordBytes(const ModifyRecord &rec)
+    {
+        if (!rec.range_)
+            return sizeof(ModifyRecord);
+        return sizeof(ModifyRecord) + sizeof(Range) + rec.range_->values_.capacity() * sizeof(T);
+    }
+
+    void restore(const ValueType &val)
+        requires std::copy_constructible<T>
+    {
+        val_ = val;
+        markDirty(0, val_.size());
+    }
+
+    void encodeSelf(ByteWriter &writer) const
+        requires Encodable<T>
+    {
+        writer.putVarint(val_.size());
+        for (auto &&e : val_)
+            encodeValue(writer, e);
+    }
+
+    bool decodeSelf(ByteReader &reader)
+        requires Encodable<T>
+    {
+        size_t count = reader.getVarint();
+        if (!reader.ok() || count > reader.remaining())
+            return false;
+        ValueType val(count);
+        for (auto &&e : val)
+            decodeValue(reader, e);
+        if (!reader.ok())
+            return false;
+        val_.swap(val);
+        markDirty(0, val_.size());
+        return true;
+    }
+
+    // 从prev开始只重新拷贝改过的那一段, 前后没改过的块直接共享
+    Snapshot makeSnapshot(const Snapshot *prev)
+        requires std::copy_constructible<T>
+    {
+        Snapshot snap;
+        size_t n = val_.size();
+        size_t keepFront = 0, keepBack = 0, begin = 0, end = n;
+        if (prev)
+        {
+            size_t m = prev->size();
+            size_t prefix = std::min({dirtyBegin_, n, m});
+            size_t suffix = std::min(dirtySuffix_, std::min(n, m) - prefix);
+            size_t chunks = prev->chunks_.size();
+            while (keepFront < chunks && prev->ends_[keepFront] <= prefix)
+                ++keepFront;
+            while (keepFront + keepBack < chunks && prev->chunkBegin(chunks - keepBack - 1) >= m - suffix)
+                ++keepBack;
+
+            // 两边太小的块并进中间一起重新切, 免得块越切越碎
+            if (keepFront && prev->chunks_[keepFront - 1]->size() < SnapshotChunkSize / 2)
+                --keepFront;
+            if (keepBack && prev->chunks_[chunks - keepBack]->size() < SnapshotChunkSize / 2)
+                --keepBack;
+            begin = prev->chunkBegin(keepFront);
+            end = n - (m - prev->chunkBegin(chunks - keepBack));
+            for (size_t i = 0; i < keepFront; ++i)
+                snap.append(prev->chunks_[i]);
+        }
+
+        while (begin < end)
+        {
+            size_t len = std::min(SnapshotChunkSize, end - begin);
+            snap.append(std::make_shared<const std::vector<T>>(val_.begin() + begin, val_.begin() + begin + len));
+            begin += len;
+        }
+        for (size_t i = prev ? prev->chunks_.size() - keepBack : 0; prev && i < prev->chunks_.size(); ++i)
+            snap.append(prev->chunks_[i]);
+
+        dirtyBegin_ = std::numeric_limits<size_t>::max();
+        dirtySuffix_ = std::numeric_limits<size_t>::max();
+        return snap;
+    }
+
     std::string serialSelf() const
     {
         std::ostringstream oss;
@@ -128,6 +736,67 @@ class AtomInterface<std::vector<T>>
         return val_;
     }
 
+    static ModifyRecord insertRangeRecord(size_t offset, size_t count)
+    {
+        return ModifyRecord{offset, ModifyType::InsertRange, {}, Range{{}, count}};
+    }
+
+    // range记录覆盖的元素个数
+    static size_t rangeSize(const ModifyRecord &rec)
+    {
+        return rec.type_ == ModifyType::InsertRange ? rec.range_->count_ : rec.range_->values_.size();
+    }
+
   private:
+
+    // [from, to)里第一个和newVal不一样的元素, 都一样时返回to; 不能比较的元素全部算变了
+    size_t nextDiff(const ValueType &newVal, size_t from, size_t to) const
+    {
+        if constexpr (std::is_trivially_copyable_v<T>)
+        {
+            size_t bytes = mismatchBytes(reinterpret_cast<const char *>(val_.data() + from),
+                                         reinterpret_cast<const char *>(newVal.data() + from), (to - from) * sizeof(T));
+            return from + bytes / sizeof(T);
+        }
+        else if constexpr (std::equality_comparable<T>)
+            return std::mismatch(val_.begin() + from, val_.begin() + to, newVal.begin() + from).first - val_.begin();
+        else
+            return from;
+    }
+
+    // offset >= from的key整体平移delta, 平移后相对顺序不变
+    static void shiftOwners(std::map<size_t, size_t> &owners, size_t from, ptrdiff_t delta)
+    {
+        auto first = owners.lower_bound(from);
+        std::vector<std::pair<size_t, size_t>> tail(first, owners.end());
+        owners.erase(first, owners.end());
+        for (auto &&[offset, index] : tail)
+            owners.emplace_hint(owners.end(), offset + delta, index);
+    }
+
+    ModifyRecord eraseRange(size_t offset, size_t count)
+    {
+        if (offset > val_.size() || count > val_.size() - offset)
+            return ModifyRecord{offset, ModifyType::Fail};
+
+        auto first = val_.begin() + offset;
+        auto last = first + count;
+        ModifyRecord rec{offset, ModifyType::EraseRange, {},
+                         Range{std::vector<T>(std::make_move_iterator(first), std::make_move_iterator(last))}};
+        val_.erase(first, last);
+        markDirty(offset, 0);
+        return rec;
+    }
+
+    // 刚改过val_里从offset开始的count个元素(删除时count为0), 收缩没改过的前缀和后缀
+    void markDirty(size_t offset, size_t count)
+    {
+        dirtyBegin_ = std::min(dirtyBegin_, offset);
+        dirtySuffix_ = std::min(dirtySuffix_, val_.size() - offset - count);
+    }
+
     ValueType val_;
+    // 上一个snapshot以来没改过的前缀长度和后缀长度
+    size_t dirtyBegin_ = std::numeric_limits<size_t>::max();
+    size_t dirtySuffix_ = std::numeric_limits<size_t>::max();
 };
\ No newline at end of file
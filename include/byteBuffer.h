@@ -0,0 +1,140 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// 一整块定长的原始字节, 放在堆上或者MAP_SHARED映射一个文件
+// 映射文件时写进去的内容由操作系统刷回文件, 内存里只留用到的页; 拷贝出来的总是堆上的
+class ByteBuffer
+{
+  public:
+    ByteBuffer() = default;
+
+    explicit ByteBuffer(size_t size) : heap_(new std::byte[size]()), data_(heap_.get()), size_(size)
+    {
+    }
+
+    ByteBuffer(const ByteBuffer &rhs) : ByteBuffer(rhs.size_)
+    {
+        if (size_)
+            memcpy(data_, rhs.data_, size_);
+    }
+
+    ByteBuffer(ByteBuffer &&rhs) noexcept
+    {
+        swap(rhs);
+    }
+
+    ByteBuffer &operator=(const ByteBuffer &rhs)
+    {
+        if (this == &rhs)
+            return *this;
+        if (size_ != rhs.size_)
+        {
+            ByteBuffer copy(rhs);
+            swap(copy);
+        }
+        else if (size_)
+        {
+            memcpy(data_, rhs.data_, size_);
+        }
+        return *this;
+    }
+
+    ByteBuffer &operator=(ByteBuffer &&rhs) noexcept
+    {
+        ByteBuffer tmp(std::move(rhs));
+        swap(tmp);
+        return *this;
+    }
+
+    ~ByteBuffer()
+    {
+        unmap();
+    }
+
+    // 把path映射成size字节的缓冲区, 文件不够长时补0, 原来的内容丢掉
+    bool map(const std::string &path, size_t size)
+    {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void *addr = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && (static_cast<size_t>(st.st_size) >= size || ::ftruncate(fd, size) == 0))
+            addr = size ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : nullptr;
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            return false;
+
+        ByteBuffer mapped;
+        mapped.data_ = static_cast<std::byte *>(addr);
+        mapped.size_ = size;
+        mapped.mapped_ = size != 0;
+        swap(mapped);
+        return true;
+    }
+
+    // 映射文件时把脏页写回文件
+    bool sync()
+    {
+        return !mapped_ || ::msync(data_, size_, MS_SYNC) == 0;
+    }
+
+    bool mapped() const
+    {
+        return mapped_;
+    }
+
+    std::byte *data()
+    {
+        return data_;
+    }
+
+    const std::byte *data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    bool operator==(const ByteBuffer &rhs) const
+    {
+        return size_ == rhs.size_ && (!size_ || memcmp(data_, rhs.data_, size_) == 0);
+    }
+
+    void swap(ByteBuffer &rhs) noexcept
+    {
+        std::swap(heap_, rhs.heap_);
+        std::swap(data_, rhs.data_);
+        std::swap(size_, rhs.size_);
+        std::swap(mapped_, rhs.mapped_);
+    }
+
+  private:
+    void unmap()
+    {
+        if (mapped_)
+            ::munmap(data_, size_);
+        mapped_ = false;
+    }
+
+    std::unique_ptr<std::byte[]> heap_;
+    std::byte *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+};
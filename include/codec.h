@@ -0,0 +1,198 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// journal用的紧凑二进制编码: 无符号整数用varint, 有符号整数先zigzag再varint
+class ByteWriter
+{
+  public:
+    void putByte(uint8_t byte)
+    {
+        buf_.push_back(static_cast<char>(byte));
+    }
+
+    void putVarint(uint64_t val)
+    {
+        while (val >= 0x80)
+        {
+            buf_.push_back(static_cast<char>(val | 0x80));
+            val >>= 7;
+        }
+        buf_.push_back(static_cast<char>(val));
+    }
+
+    void putZigzag(int64_t val)
+    {
+        putVarint((static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63));
+    }
+
+    void putBytes(const void *data, size_t len)
+    {
+        buf_.append(static_cast<const char *>(data), len);
+    }
+
+    void clear()
+    {
+        buf_.clear();
+    }
+
+    // 回退到之前的某个长度, 丢掉之后写入的内容
+    void truncate(size_t len)
+    {
+        buf_.resize(len);
+    }
+
+    bool empty() const
+    {
+        return buf_.empty();
+    }
+
+    size_t size() const
+    {
+        return buf_.size();
+    }
+
+    const std::string &data() const
+    {
+        return buf_;
+    }
+
+  private:
+    std::string buf_;
+};
+
+// 读越界之后ok()返回false, 之后读出来的都是0
+class ByteReader
+{
+  public:
+    ByteReader(const char *data, size_t len) : cur_(data), end_(data + len)
+    {
+    }
+
+    uint8_t getByte()
+    {
+        if (cur_ == end_)
+        {
+            ok_ = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(*cur_++);
+    }
+
+    uint64_t getVarint()
+    {
+        uint64_t val = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t byte = getByte();
+            val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return val;
+        }
+        ok_ = false;
+        return 0;
+    }
+
+    int64_t getZigzag()
+    {
+        uint64_t val = getVarint();
+        return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+    }
+
+    bool getBytes(void *data, size_t len)
+    {
+        if (static_cast<size_t>(end_ - cur_) < len)
+        {
+            ok_ = false;
+            cur_ = end_;
+            return false;
+        }
+        memcpy(data, cur_, len);
+        cur_ += len;
+        return true;
+    }
+
+    bool empty() const
+    {
+        return cur_ == end_;
+    }
+
+    size_t remaining() const
+    {
+        return end_ - cur_;
+    }
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+    // 内容不合法, 后面的读取全部失败
+    void fail()
+    {
+        ok_ = false;
+        cur_ = end_;
+    }
+
+  private:
+    const char *cur_;
+    const char *end_;
+    bool ok_ = true;
+};
+
+// 值的编码, 需要其他类型时在这里加重载
+template <typename T>
+    requires std::is_integral_v<T>
+void encodeValue(ByteWriter &writer, T val)
+{
+    if constexpr (std::is_signed_v<T>)
+        writer.putZigzag(val);
+    else
+        writer.putVarint(val);
+}
+
+template <typename T>
+    requires std::is_integral_v<T>
+void decodeValue(ByteReader &reader, T &val)
+{
+    if constexpr (std::is_signed_v<T>)
+        val = static_cast<T>(reader.getZigzag());
+    else
+        val = static_cast<T>(reader.getVarint());
+}
+
+template <typename T>
+    requires std::is_floating_point_v<T>
+void encodeValue(ByteWriter &writer, T val)
+{
+    writer.putBytes(&val, sizeof(T));
+}
+
+template <typename T>
+    requires std::is_floating_point_v<T>
+void decodeValue(ByteReader &reader, T &val)
+{
+    reader.getBytes(&val, sizeof(T));
+}
+
+inline void encodeValue(ByteWriter &writer, const std::string &val)
+{
+    writer.putVarint(val.size());
+    writer.putBytes(val.data(), val.size());
+}
+
+inline void decodeValue(ByteReader &reader, std::string &val)
+{
+    size_t len = reader.getVarint();
+    val.resize(len <= reader.remaining() ? len : 0);
+    reader.getBytes(val.data(), len);
+}
+
+// 有上面的编码的类型, journal和冷历史压缩只支持这些元素类型
+template <typename T>
+concept Encodable = requires(ByteWriter &writer, ByteReader &reader, const T &val, T &out) {
+    encodeValue(writer, val);
+    decodeValue(reader, out);
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include "atomicIntegral.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// 多个线程同时对一个整数做事务
+// 每个线程在自己的Transaction里修改, endTransaction用CAS把beginTransaction时看到的值换成新值
+// 期间别的线程提交过时CAS失败, 返回Conflict, 由调用方重试, transact会自动重试
+// 每个提交过的事务在一个无锁的环形历史里占一格, undo(id)同样用CAS把值换回去
+template <Integral T>
+class ConcurrentIntegral
+{
+  public:
+    typedef T ValueType;
+    typedef size_t CommitId;
+    typedef typename AtomInterface<T>::ModifyType ModifyType;
+
+    static constexpr CommitId EmptyTransaction = std::numeric_limits<size_t>::max();
+    static constexpr CommitId Conflict = std::numeric_limits<size_t>::max() - 1;
+    static constexpr size_t DefaultHistoryCapacity = 4096;
+
+    // 只属于一个线程
+    class Transaction
+    {
+      public:
+        template <Integral Input>
+        void modify(ModifyType, Input newVal)
+        {
+            val_ = newVal;
+            modified_ = true;
+        }
+
+        const T &get() const
+        {
+            return val_;
+        }
+
+        // value seen at beginTransaction
+        const T &base() const
+        {
+            return base_;
+        }
+
+      private:
+        friend class ConcurrentIntegral;
+
+        void reset(T val)
+        {
+            base_ = val_ = val;
+            modified_ = false;
+        }
+
+        T base_{};
+        T val_{};
+        bool modified_ = false;
+    };
+
+  public:
+    explicit ConcurrentIntegral(T val, size_t historyCapacity = DefaultHistoryCapacity)
+        : val_(val), capacity_(std::max<size_t>(historyCapacity, 1)), history_(new Entry[capacity_])
+    {
+    }
+
+    ConcurrentIntegral(const ConcurrentIntegral &) = delete;
+    ConcurrentIntegral &operator=(const ConcurrentIntegral &) = delete;
+
+    T get() const
+    {
+        return val_.load(std::memory_order_acquire);
+    }
+
+    Transaction beginTransaction() const
+    {
+        Transaction tx;
+        tx.reset(get());
+        return tx;
+    }
+
+    // 没有修改时返回EmptyTransaction, 冲突时返回Conflict并把tx重新开始在最新的值上
+    CommitId endTransaction(Transaction &tx)
+    {
+        if (!tx.modified_)
+            return EmptyTransaction;
+
+        T expected = tx.base_;
+        if (!val_.compare_exchange_strong(expected, tx.val_, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            conflicts_.fetch_add(1, std::memory_order_relaxed);
+            tx.reset(expected);
+            return Conflict;
+        }
+
+        CommitId id = append(tx.base_, tx.val_);
+        tx.reset(tx.val_);
+        return id;
+    }
+
+    // fn(tx)在冲突时在最新的值上重新执行, 超过maxRetries次返回Conflict
+    template <typename Fn>
+    CommitId transact(Fn &&fn, size_t maxRetries = std::numeric_limits<size_t>::max())
+    {
+        Transaction tx = beginTransaction();
+        for (size_t retry = 0;; ++retry)
+        {
+            fn(tx);
+            CommitId id = endTransaction(tx);
+            if (id != Conflict || retry == maxRetries)
+                return id;
+        }
+    }
+
+    // 把值从commit id的新值换回旧值, 产生一个新的commit, 对这个新commit再undo就是redo
+    // id之后别的提交改过这个值, id已经被撤销过或者已经被挤出历史时返回Conflict
+    CommitId undo(CommitId id)
+    {
+        if (id >= Conflict)
+            return Conflict;
+        Entry &entry = history_[id % capacity_];
+        uint64_t seq = Entry::sequence(id, Entry::committed);
+        if (!entry.seq_.compare_exchange_strong(seq, Entry::sequence(id, Entry::undoing), std::memory_order_acquire))
+            return Conflict;
+
+        T expected = entry.newVal_;
+        T oldVal = entry.oldVal_;
+        bool reverted =
+            val_.compare_exchange_strong(expected, oldVal, std::memory_order_acq_rel, std::memory_order_acquire);
+        entry.seq_.store(Entry::sequence(id, reverted ? Entry::undone : Entry::committed), std::memory_order_release);
+        if (!reverted)
+        {
+            conflicts_.fetch_add(1, std::memory_order_relaxed);
+            return Conflict;
+        }
+        return append(expected, oldVal);
+    }
+
+    // 被CAS失败打回的次数
+    size_t conflicts() const
+    {
+        return conflicts_.load(std::memory_order_relaxed);
+    }
+
+    size_t historyCapacity() const
+    {
+        return capacity_;
+    }
+
+  private:
+    // seq_ = id * 4 + state, 写入和undo都先把seq_ CAS到自己的中间状态, 其他线程看到中间状态就不碰字段
+    struct Entry
+    {
+        enum State : uint64_t
+        {
+            writing,
+            committed,
+            undoing,
+            undone
+        };
+
+        static constexpr uint64_t Free = std::numeric_limits<uint64_t>::max();
+
+        static uint64_t sequence(CommitId id, State state)
+        {
+            return static_cast<uint64_t>(id) * 4 + state;
+        }
+
+        std::atomic<uint64_t> seq_{Free};
+        T oldVal_{};
+        T newVal_{};
+    };
+
+    // 环形历史, 新的commit覆盖capacity_之前的那一格
+    CommitId append(T oldVal, T newVal)
+    {
+        CommitId id = nextCommitId_.fetch_add(1, std::memory_order_relaxed);
+        Entry &entry = history_[id % capacity_];
+        uint64_t seq = entry.seq_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            // 写得太慢, 已经被后面一圈的commit占了, 这一格的历史直接放弃
+            if (seq != Entry::Free && seq / 4 > id)
+                return id;
+            // 上一圈的commit正在写入或者undo, 很快就会结束
+            if (seq != Entry::Free && (seq % 4 == Entry::writing || seq % 4 == Entry::undoing))
+            {
+                seq = entry.seq_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (entry.seq_.compare_exchange_weak(seq, Entry::sequence(id, Entry::writing), std::memory_order_acquire,
+                                                 std::memory_order_relaxed))
+                break;
+        }
+        entry.oldVal_ = oldVal;
+        entry.newVal_ = newVal;
+        entry.seq_.store(Entry::sequence(id, Entry::committed), std::memory_order_release);
+        return id;
+    }
+
+    std::atomic<T> val_;
+    const size_t capacity_;
+    std::unique_ptr<Entry[]> history_;
+    std::atomic<CommitId> nextCommitId_{0};
+    std::atomic<size_t> conflicts_{0};
+};
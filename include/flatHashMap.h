@@ -0,0 +1,341 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 开放寻址的hash map, 线性探测, 每个槽一个控制字节
+// 控制字节: Empty / Deleted(墓碑) / hash的低7位, 探测时先比控制字节, 很少真的去比key
+// 删除只留墓碑, 从不移动别的元素, 所以槽号在下一次rehash之前一直有效, AtomInterface的记录靠这一点
+// K和V需要能默认构造
+template <typename K, typename V, typename Hash = std::hash<K>>
+class FlatHashMap
+{
+  public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    class const_iterator
+    {
+      public:
+        const value_type &operator*() const
+        {
+            return map_->slots_[slot_];
+        }
+
+        const value_type *operator->() const
+        {
+            return &map_->slots_[slot_];
+        }
+
+        const_iterator &operator++()
+        {
+            slot_ = map_->nextFull(slot_ + 1);
+            return *this;
+        }
+
+        bool operator==(const const_iterator &rhs) const
+        {
+            return slot_ == rhs.slot_;
+        }
+
+        size_t slot() const
+        {
+            return slot_;
+        }
+
+      private:
+        friend class FlatHashMap;
+
+        const_iterator(const FlatHashMap *map, size_t slot) : map_(map), slot_(slot)
+        {
+        }
+
+        const FlatHashMap *map_;
+        size_t slot_;
+    };
+
+  public:
+    FlatHashMap() = default;
+
+    FlatHashMap(std::initializer_list<value_type> init)
+    {
+        for (auto &&[key, val] : init)
+            insert(key, val);
+    }
+
+    template <typename H, typename E, typename A>
+    explicit FlatHashMap(const std::unordered_map<K, V, H, E, A> &map)
+    {
+        reserve(map.size());
+        for (auto &&[key, val] : map)
+            insert(key, val);
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t capacity() const
+    {
+        return ctrl_.size();
+    }
+
+    // 每次rehash加一, 记录里的槽号只在同一个generation里有效
+    size_t generation() const
+    {
+        return generation_;
+    }
+
+    // 诊断用: 元素离自己home最远要探测几步, 遍历整个表
+    size_t maxProbeLength() const
+    {
+        size_t mask = ctrl_.size() - 1;
+        size_t longest = 0;
+        for (size_t slot = nextFull(0); slot < ctrl_.size(); slot = nextFull(slot + 1))
+            longest = std::max(longest, (slot - home(hashOf(slots_[slot].first))) & mask);
+        return longest;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, nextFull(0));
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, capacity());
+    }
+
+    const V *find(const K &key) const
+    {
+        size_t slot = findSlot(key);
+        return slot == npos ? nullptr : &slots_[slot].second;
+    }
+
+    bool contains(const K &key) const
+    {
+        return findSlot(key) != npos;
+    }
+
+    const V &at(const K &key) const
+    {
+        return slots_[findSlot(key)].second;
+    }
+
+    std::unordered_map<K, V, Hash> toUnorderedMap() const
+    {
+        std::unordered_map<K, V, Hash> map(size_);
+        for (auto &&[key, val] : *this)
+            map.emplace(key, val);
+        return map;
+    }
+
+    bool operator==(const FlatHashMap &rhs) const
+    {
+        if (size_ != rhs.size_)
+            return false;
+        for (auto &&[key, val] : *this)
+        {
+            const V *other = rhs.find(key);
+            if (!other || !(*other == val))
+                return false;
+        }
+        return true;
+    }
+
+    template <typename H, typename E, typename A>
+    bool operator==(const std::unordered_map<K, V, H, E, A> &rhs) const
+    {
+        if (size_ != rhs.size())
+            return false;
+        for (auto &&[key, val] : rhs)
+        {
+            const V *other = find(key);
+            if (!other || !(*other == val))
+                return false;
+        }
+        return true;
+    }
+
+    void reserve(size_t count)
+    {
+        size_t capacity = MinCapacity;
+        while (capacity * MaxLoadNum / MaxLoadDen < count)
+            capacity *= 2;
+        if (capacity > ctrl_.size())
+            rehash(capacity);
+    }
+
+    // 已经有这个key时返回npos, 否则返回放进去的槽
+    size_t insert(const K &key, V val)
+    {
+        size_t hash = hashOf(key);
+        if (findSlot(key, hash) != npos)
+            return npos;
+        size_t slot = freeSlot(hash);
+        if (ctrl_[slot] == Empty)
+        {
+            if (size_ + deleted_ + 1 > ctrl_.size() * MaxLoadNum / MaxLoadDen)
+            {
+                rehash(deleted_ > size_ / 2 ? ctrl_.size() : std::max(MinCapacity, ctrl_.size() * 2));
+                slot = freeSlot(hash);
+            }
+        }
+        place(slot, hash, key, std::move(val));
+        return slot;
+    }
+
+    bool assign(const K &key, V val)
+    {
+        size_t slot = findSlot(key);
+        if (slot == npos)
+            return false;
+        slots_[slot].second = std::move(val);
+        return true;
+    }
+
+    bool erase(const K &key)
+    {
+        size_t slot = findSlot(key);
+        if (slot == npos)
+            return false;
+        eraseSlot(slot);
+        return true;
+    }
+
+  private:
+    template <typename T>
+    friend class AtomInterface;
+
+    static constexpr uint8_t Empty = 0x80;
+    static constexpr uint8_t Deleted = 0xfe;
+    static constexpr size_t MinCapacity = 8;
+    static constexpr size_t MaxLoadNum = 7; // (size + tombstones) / capacity <= 7/8
+    static constexpr size_t MaxLoadDen = 8;
+
+    // std::hash<int>这类是恒等映射, 连续的key会挤在一起; 乘一个奇数常数打散,
+    // 高位混得最好, 用来定位置, 低7位做控制字节
+    static size_t hashOf(const K &key)
+    {
+        return static_cast<size_t>(Hash{}(key)) * static_cast<size_t>(0x9E3779B97F4A7C15ull);
+    }
+
+    static uint8_t fragment(size_t hash)
+    {
+        return hash & 0x7f;
+    }
+
+    size_t home(size_t hash) const
+    {
+        return hash >> (std::numeric_limits<size_t>::digits - std::countr_zero(ctrl_.size()));
+    }
+
+    size_t findSlot(const K &key) const
+    {
+        return findSlot(key, hashOf(key));
+    }
+
+    size_t findSlot(const K &key, size_t hash) const
+    {
+        if (ctrl_.empty())
+            return npos;
+        size_t mask = ctrl_.size() - 1;
+        uint8_t frag = fragment(hash);
+        for (size_t slot = home(hash), probe = 0; probe <= mask; slot = (slot + 1) & mask, ++probe)
+        {
+            if (ctrl_[slot] == Empty)
+                return npos;
+            if (ctrl_[slot] == frag && slots_[slot].first == key)
+                return slot;
+        }
+        return npos;
+    }
+
+    // 探测路径上第一个墓碑或者空槽, 调用方保证key不在表里
+    size_t freeSlot(size_t hash)
+    {
+        if (ctrl_.empty())
+            rehash(MinCapacity);
+        size_t mask = ctrl_.size() - 1;
+        size_t slot = home(hash);
+        while (ctrl_[slot] != Empty && ctrl_[slot] != Deleted)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    void place(size_t slot, size_t hash, const K &key, V val)
+    {
+        if (ctrl_[slot] == Deleted)
+            --deleted_;
+        ctrl_[slot] = fragment(hash);
+        slots_[slot].first = key;
+        slots_[slot].second = std::move(val);
+        ++size_;
+    }
+
+    // 放回被删掉时的槽, 不探测也不rehash
+    // 同一个generation里Empty不会重新出现, 槽还是墓碑时从home到它的探测路径仍然有效
+    bool placeAt(size_t slot, size_t generation, const K &key, V &val)
+    {
+        if (generation != generation_ || slot >= ctrl_.size() || ctrl_[slot] != Deleted)
+            return false;
+        size_t hash = hashOf(key);
+        place(slot, hash, key, std::move(val));
+        return true;
+    }
+
+    void eraseSlot(size_t slot)
+    {
+        ctrl_[slot] = Deleted;
+        slots_[slot] = value_type();
+        --size_;
+        ++deleted_;
+    }
+
+    size_t nextFull(size_t slot) const
+    {
+        while (slot < ctrl_.size() && (ctrl_[slot] & 0x80))
+            ++slot;
+        return slot;
+    }
+
+    void rehash(size_t capacity)
+    {
+        std::vector<uint8_t> ctrl(capacity, Empty);
+        std::vector<value_type> slots(capacity);
+        ctrl.swap(ctrl_);
+        slots.swap(slots_);
+        size_ = 0;
+        deleted_ = 0;
+        ++generation_;
+        for (size_t slot = 0; slot < ctrl.size(); ++slot)
+        {
+            if (ctrl[slot] & 0x80)
+                continue;
+            size_t hash = hashOf(slots[slot].first);
+            place(freeSlot(hash), hash, slots[slot].first, std::move(slots[slot].second));
+        }
+    }
+
+    std::vector<uint8_t> ctrl_;
+    std::vector<value_type> slots_;
+    size_t size_ = 0;
+    size_t deleted_ = 0;
+    size_t generation_ = 0;
+};
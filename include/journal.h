@@ -0,0 +1,546 @@
+#pragma once
+#include "codec.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+struct JournalOptions
+{
+    bool syncEachCommit_ = false; // 每帧写完都fsync
+    bool snapshots_ = true;       // checkpoint时在journal旁边写snapshot, open时只重放snapshot之后的帧
+    // append只把帧放进队列, 后台线程攒成一次大的write, 每groupCommitMicros_最多fsync一次
+    // 和syncEachCommit_一起用时每次write之后都fsync
+    bool async_ = false;
+    uint32_t groupCommitMicros_ = 1000;
+};
+
+// 追加写的二进制journal文件
+// 文件头: "TXJ1"
+// 每一帧: fixed32 payload长度, fixed32 payload的FNV-1a校验, payload
+// 写到一半的最后一帧在open时被截掉
+// 异步模式下只有一个线程append, 写线程是唯一的消费者; size()和snapshot要在sync()之后才准确
+// snapshot: path + ".snap", "TXS1", fixed32 长度, fixed32 校验,
+//           varint 最后一帧的offset, varint 文件长度, varint 最后一帧的校验, 调用方的状态
+class Journal
+{
+  public:
+    typedef JournalOptions Options;
+
+    // payload里的事件类型, 每个事件以这个字节开头
+    enum class Event : uint8_t
+    {
+        begin = 1, // varint id, varint parentId + 1 (0 -> root)
+        record,    // AtomInterface::encodeRecord的内容
+        end,       // varint id
+        undo,      // varint 新commit的id, varint 被撤销的commit的id, varint parentId + 1
+        redo,      // varint 新commit的id, varint 被重做的undo commit的id, varint parentId + 1
+        reset,     // varint 回退到的commit的id
+        checkout   // varint 新commit的id, varint 回到的commit的id
+    };
+
+    static constexpr char Magic[4] = {'T', 'X', 'J', '1'};
+    static constexpr char SnapshotMagic[4] = {'T', 'X', 'S', '1'};
+    static constexpr size_t FrameHeaderSize = 8;
+    static constexpr size_t QueueCapacity = 1024; // 异步模式下最多排队的帧, 满了append等写线程
+
+  public:
+    Journal() = default;
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    ~Journal()
+    {
+        close();
+    }
+
+    bool open(const std::string &path, const Options &options = {})
+    {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd_ < 0)
+            return false;
+        path_ = path;
+        options_ = options;
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0)
+            return fail();
+        size_ = st.st_size;
+        if (size_ == 0)
+        {
+            if (::write(fd_, Magic, sizeof(Magic)) != sizeof(Magic))
+                return fail();
+            size_ = sizeof(Magic);
+            return true;
+        }
+
+        char magic[sizeof(Magic)];
+        if (size_ < sizeof(Magic) || ::pread(fd_, magic, sizeof(magic), 0) != sizeof(magic) ||
+            memcmp(magic, Magic, sizeof(Magic)) != 0)
+            return fail();
+        return true;
+    }
+
+    // 从mmap的文件里按顺序把from之后每一帧的payload交给onFrame, onFrame返回false时停止
+    // 校验失败的尾部会被截掉, 后续追加从最后一个完整帧之后开始
+    template <typename OnFrame>
+    bool replay(OnFrame &&onFrame, uint64_t from = sizeof(Magic))
+    {
+        if (fd_ < 0 || from < sizeof(Magic) || from > size_)
+            return false;
+        if (size_ == from)
+            return true;
+
+        void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (addr == MAP_FAILED)
+            return false;
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+
+        const char *data = static_cast<const char *>(addr);
+        uint64_t offset = from;
+        if (from == sizeof(Magic))
+            lastFrame_ = lastChecksum_ = 0;
+        bool consistent = true;
+        while (offset + FrameHeaderSize <= size_)
+        {
+            uint32_t len = loadFixed32(data + offset);
+            uint32_t checksum = loadFixed32(data + offset + 4);
+            if (len > size_ - offset - FrameHeaderSize)
+                break;
+            const char *payload = data + offset + FrameHeaderSize;
+            if (fnv1a(payload, len) != checksum)
+                break;
+
+            ByteReader reader(payload, len);
+            if (!onFrame(reader))
+            {
+                consistent = false;
+                break;
+            }
+            lastFrame_ = offset;
+            lastChecksum_ = checksum;
+            offset += FrameHeaderSize + len;
+        }
+        ::munmap(addr, size_);
+
+        if (consistent && offset < size_)
+        {
+            if (::ftruncate(fd_, offset) != 0)
+                return false;
+            size_ = offset;
+        }
+        return consistent;
+    }
+
+    // 异步模式下帧进了队列就返回true, 写失败之后一直返回false
+    bool append(const std::string &payload)
+    {
+        if (fd_ < 0 || failed())
+            return false;
+
+        uint32_t checksum = fnv1a(payload.data(), payload.size());
+        frame_.clear();
+        appendFixed32(frame_, payload.size());
+        appendFixed32(frame_, checksum);
+        frame_.append(payload);
+        if (options_.async_)
+            return enqueue();
+
+        if (!writeAll(frame_))
+        {
+            // 写了一半的帧截掉, 截不掉时重新打开的校验也会丢掉它; 和异步模式一样之后都失败
+            bool truncated = ::ftruncate(fd_, size_) == 0;
+            (void)truncated;
+            latchFailure();
+            return false;
+        }
+        lastFrame_ = size_;
+        lastChecksum_ = checksum;
+        size_ += frame_.size();
+        if (options_.syncEachCommit_ && ::fdatasync(fd_) != 0)
+        {
+            latchFailure();
+            return false;
+        }
+        return true;
+    }
+
+    // 异步模式下等写线程把已经append的帧都写完并fsync
+    bool sync()
+    {
+        if (fd_ < 0)
+            return false;
+        if (!writer_.joinable())
+            return !failed() && ::fdatasync(fd_) == 0;
+        return waitSynced(tail_.load(std::memory_order_relaxed));
+    }
+
+    // 到目前为止append的帧都落盘之后调用callback(ok)
+    // 异步模式下在写线程上调用, 不要在里面再append; 否则先sync()再直接调用
+    void whenDurable(std::function<void(bool)> callback)
+    {
+        if (!writer_.joinable())
+        {
+            callback(sync());
+            return;
+        }
+        uint64_t target = tail_.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            uint64_t synced = synced_.load(std::memory_order_acquire);
+            if (!(synced & FailedBit) && synced < target)
+            {
+                callbacks_.emplace_back(target, std::move(callback));
+                return;
+            }
+        }
+        callback(!failed());
+    }
+
+    // 异步写或fsync失败过
+    bool failed() const
+    {
+        return synced_.load(std::memory_order_acquire) & FailedBit;
+    }
+
+    // 异步模式下先等写线程把队列写完并fsync
+    void close()
+    {
+        stopWriter();
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+        size_ = 0;
+        lastFrame_ = lastChecksum_ = 0;
+    }
+
+    bool isOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+    const Options &options() const
+    {
+        return options_;
+    }
+
+    // snapshot和journal放在一起, 只保留最新的一个
+    std::string snapshotPath() const
+    {
+        return path_ + ".snap";
+    }
+
+    // state对应journal当前的末尾, 先写临时文件再rename, 崩溃时要么是旧的snapshot要么是新的
+    bool writeSnapshot(const std::string &state)
+    {
+        if (fd_ < 0)
+            return false;
+
+        ByteWriter payload;
+        payload.putVarint(lastFrame_);
+        payload.putVarint(size_);
+        payload.putVarint(lastChecksum_);
+        payload.putBytes(state.data(), state.size());
+
+        std::string buf(SnapshotMagic, sizeof(SnapshotMagic));
+        appendFixed32(buf, payload.size());
+        appendFixed32(buf, fnv1a(payload.data().data(), payload.size()));
+        buf.append(payload.data());
+
+        std::string tmpPath = snapshotPath() + ".tmp";
+        int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        bool ok = ::write(fd, buf.data(), buf.size()) == static_cast<ssize_t>(buf.size()) && ::fdatasync(fd) == 0;
+        ::close(fd);
+        return ok && ::rename(tmpPath.c_str(), snapshotPath().c_str()) == 0;
+    }
+
+    // 读出snapshot的state和它之后第一帧的offset, 记下的最后一帧和journal里的不一样时返回false
+    bool readSnapshot(std::string &state, uint64_t &from)
+    {
+        if (fd_ < 0)
+            return false;
+        int fd = ::open(snapshotPath().c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        std::string payload;
+        char header[sizeof(SnapshotMagic) + FrameHeaderSize];
+        bool ok = ::read(fd, header, sizeof(header)) == sizeof(header) &&
+                  memcmp(header, SnapshotMagic, sizeof(SnapshotMagic)) == 0;
+        if (ok)
+        {
+            payload.resize(loadFixed32(header + sizeof(SnapshotMagic)));
+            ok = ::read(fd, payload.data(), payload.size()) == static_cast<ssize_t>(payload.size()) &&
+                 fnv1a(payload.data(), payload.size()) == loadFixed32(header + sizeof(SnapshotMagic) + 4);
+        }
+        ::close(fd);
+        if (!ok)
+            return false;
+
+        ByteReader reader(payload.data(), payload.size());
+        uint64_t frame = reader.getVarint();
+        uint64_t end = reader.getVarint();
+        uint64_t checksum = reader.getVarint();
+        if (!reader.ok() || !matchFrame(frame, end, checksum))
+            return false;
+        state.assign(payload.data() + payload.size() - reader.remaining(), reader.remaining());
+        from = end;
+        lastFrame_ = frame;
+        lastChecksum_ = checksum;
+        return true;
+    }
+
+    // file size in bytes
+    uint64_t size() const
+    {
+        return size_;
+    }
+
+    static uint32_t fnv1a(const char *data, size_t len)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; ++i)
+        {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+  private:
+    static constexpr uint64_t FailedBit = uint64_t(1) << 63;
+
+    bool enqueue()
+    {
+        if (!writer_.joinable())
+        {
+            stop_ = false;
+            ring_.resize(QueueCapacity);
+            writer_ = std::thread([this] { writeLoop(); });
+        }
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        while (tail - head_.load(std::memory_order_acquire) == QueueCapacity)
+        {
+            wakeWriter(true);
+            std::this_thread::yield();
+        }
+        // 换出来的是写线程清空过的旧帧, 复用它的空间
+        ring_[tail % QueueCapacity].swap(frame_);
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        wakeWriter(false);
+        return true;
+    }
+
+    // 和写线程的sleeping_/tail_配对: 要么写线程看到新的tail_, 要么这里看到它在睡
+    void wakeWriter(bool always)
+    {
+        if (always || sleeping_.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_one();
+        }
+    }
+
+    bool waitSynced(uint64_t target)
+    {
+        syncRequested_.store(true, std::memory_order_relaxed);
+        wakeWriter(true);
+        uint64_t synced = synced_.load(std::memory_order_acquire);
+        while (!(synced & FailedBit) && synced < target)
+        {
+            synced_.wait(synced, std::memory_order_acquire);
+            synced = synced_.load(std::memory_order_acquire);
+        }
+        return !(synced & FailedBit);
+    }
+
+    void stopWriter()
+    {
+        if (!writer_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            cv_.notify_one();
+        }
+        writer_.join();
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        synced_.store(0, std::memory_order_relaxed);
+    }
+
+    // 写线程: 把队列里所有的帧拼成一次write, 到了group commit的时间或者有人在等时fsync
+    void writeLoop()
+    {
+        using Clock = std::chrono::steady_clock;
+        const auto interval = std::chrono::microseconds(options_.groupCommitMicros_);
+        auto lastSync = Clock::now();
+        uint64_t written = 0;
+        bool ok = true;
+        std::string batch;
+        for (;;)
+        {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            uint64_t tail = tail_.load(std::memory_order_acquire);
+            batch.clear();
+            for (; head < tail; ++head)
+            {
+                std::string &frame = ring_[head % QueueCapacity];
+                lastFrame_ = size_ + batch.size();
+                lastChecksum_ = loadFixed32(frame.data() + 4);
+                batch.append(frame);
+                frame.clear();
+            }
+            head_.store(tail, std::memory_order_release);
+            if (!batch.empty())
+            {
+                ok = ok && writeAll(batch);
+                if (ok)
+                    size_ += batch.size();
+                written = tail;
+            }
+
+            bool stop = stop_.load(std::memory_order_relaxed) && tail == tail_.load(std::memory_order_seq_cst);
+            uint64_t synced = synced_.load(std::memory_order_relaxed) & ~FailedBit;
+            auto now = Clock::now();
+            if (written > synced && (options_.syncEachCommit_ || stop || now - lastSync >= interval ||
+                                     syncRequested_.load(std::memory_order_relaxed)))
+            {
+                syncRequested_.store(false, std::memory_order_relaxed);
+                ok = ok && ::fdatasync(fd_) == 0;
+                lastSync = now;
+                publishSynced(ok ? written : written | FailedBit);
+            }
+            else if (!ok && !failed())
+                publishSynced(written | FailedBit);
+            if (stop)
+                return;
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            sleeping_.store(true, std::memory_order_seq_cst);
+            auto ready = [&] {
+                return tail_.load(std::memory_order_seq_cst) != tail || stop_.load(std::memory_order_relaxed) ||
+                       (written > (synced_.load(std::memory_order_relaxed) & ~FailedBit) &&
+                        syncRequested_.load(std::memory_order_relaxed));
+            };
+            if (written > (synced_.load(std::memory_order_relaxed) & ~FailedBit) && !failed())
+                cv_.wait_until(lock, lastSync + interval, ready);
+            else
+                cv_.wait(lock, ready);
+            sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // 同步模式下没有写线程, 直接置上FailedBit
+    void latchFailure()
+    {
+        synced_.fetch_or(FailedBit, std::memory_order_release);
+    }
+
+    bool writeAll(const std::string &buf)
+    {
+        size_t done = 0;
+        while (done < buf.size())
+        {
+            ssize_t n = ::write(fd_, buf.data() + done, buf.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            done += n;
+        }
+        return true;
+    }
+
+    // 先发布synced_再取回调, whenDurable在锁里看到旧值时回调一定已经放进了callbacks_
+    void publishSynced(uint64_t synced)
+    {
+        synced_.store(synced, std::memory_order_release);
+        synced_.notify_all();
+
+        std::vector<std::pair<uint64_t, std::function<void(bool)>>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto split = std::partition(callbacks_.begin(), callbacks_.end(), [&](auto &callback) {
+                return !(synced & FailedBit) && callback.first > synced;
+            });
+            std::move(split, callbacks_.end(), std::back_inserter(ready));
+            callbacks_.erase(split, callbacks_.end());
+        }
+        for (auto &callback : ready)
+            callback.second(!(synced & FailedBit));
+    }
+
+    bool fail()
+    {
+        close();
+        return false;
+    }
+
+    // [frame, end)是journal里一个完整的帧, 校验和checksum一样
+    bool matchFrame(uint64_t frame, uint64_t end, uint64_t checksum) const
+    {
+        if (end > size_)
+            return false;
+        if (frame == 0)
+            return end == sizeof(Magic) && checksum == 0;
+
+        char header[FrameHeaderSize];
+        return frame >= sizeof(Magic) && frame + FrameHeaderSize <= end &&
+               ::pread(fd_, header, sizeof(header), frame) == sizeof(header) &&
+               loadFixed32(header) == end - frame - FrameHeaderSize && loadFixed32(header + 4) == checksum;
+    }
+
+    static void appendFixed32(std::string &buf, uint32_t val)
+    {
+        char bytes[4] = {static_cast<char>(val), static_cast<char>(val >> 8), static_cast<char>(val >> 16),
+                         static_cast<char>(val >> 24)};
+        buf.append(bytes, sizeof(bytes));
+    }
+
+    static uint32_t loadFixed32(const char *data)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    std::string path_;
+    uint64_t lastFrame_ = 0; // offset of the last complete frame, 0 -> none
+    uint32_t lastChecksum_ = 0;
+    Options options_;
+    std::string frame_;
+
+    // 异步模式: ring_[head_, tail_)是排队的帧, tail_只由append的线程写, head_只由写线程写
+    // synced_是已经fsync的帧数, 最高位表示写失败
+    std::vector<std::string> ring_;
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> tail_{0};
+    std::atomic<uint64_t> synced_{0};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> syncRequested_{false};
+    std::atomic<bool> stop_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::pair<uint64_t, std::function<void(bool)>>> callbacks_;
+    std::thread writer_;
+};
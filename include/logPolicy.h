@@ -0,0 +1,67 @@
+#pragma once
+#include <iostream>
+
+// TransInterface的日志策略
+// compiled == false时所有LOG语句连同参数的求值都在编译期去掉
+struct NoLog
+{
+    static constexpr bool compiled = false;
+
+    bool enabled() const
+    {
+        return false;
+    }
+
+    void enable()
+    {
+    }
+
+    void disable()
+    {
+    }
+
+    std::ostream &stream()
+    {
+        return std::cout;
+    }
+};
+
+// 每个实例单独开关, 默认关闭
+class StreamLog
+{
+  public:
+    static constexpr bool compiled = true;
+
+    explicit StreamLog(std::ostream &os = std::cout) : os_(&os)
+    {
+    }
+
+    bool enabled() const
+    {
+        return enabled_;
+    }
+
+    void enable()
+    {
+        enabled_ = true;
+    }
+
+    void disable()
+    {
+        enabled_ = false;
+    }
+
+    void setStream(std::ostream &os)
+    {
+        os_ = &os;
+    }
+
+    std::ostream &stream()
+    {
+        return *os_;
+    }
+
+  private:
+    std::ostream *os_;
+    bool enabled_ = false;
+};
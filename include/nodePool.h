@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// 节点地址在池的生命周期内不变, release的节点调用reset()后留在free list里复用,
+// 节点内部vector的capacity也一起保留下来
+template <typename Node>
+class NodePool
+{
+  public:
+    NodePool() = default;
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    Node *acquire()
+    {
+        if (free_.empty())
+            return &nodes_.emplace_back();
+
+        Node *node = free_.back();
+        free_.pop_back();
+        return node;
+    }
+
+    void release(Node *node)
+    {
+        node->reset();
+        free_.push_back(node);
+    }
+
+    // nodes in use
+    size_t size() const
+    {
+        return nodes_.size() - free_.size();
+    }
+
+    size_t capacity() const
+    {
+        return nodes_.size();
+    }
+
+  private:
+    std::deque<Node> nodes_;
+    std::vector<Node *> free_;
+};
@@ -0,0 +1,401 @@
+#pragma once
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+// 持久化的vector: 叶子是一段连续的元素, 内部节点记录每个子树的大小, 下标定位/插入/删除都是O(log n)
+// 拷贝只复制根指针, 两份共享所有节点; 修改时沿路径只复制被共享的节点, 没被共享的节点原地改
+template <typename T>
+class PersistentVector
+{
+    struct Node;
+    typedef std::shared_ptr<Node> NodePtr;
+
+  public:
+    typedef T value_type;
+
+    static constexpr size_t LeafMax = std::max<size_t>(32, 2048 / sizeof(T));
+    static constexpr size_t BranchMax = 32;
+
+    class const_iterator
+    {
+      public:
+        const T &operator*() const
+        {
+            return leaf_->values_[index_ - leafBegin_];
+        }
+
+        const T *operator->() const
+        {
+            return &**this;
+        }
+
+        const_iterator &operator++()
+        {
+            if (++index_ - leafBegin_ == leaf_->values_.size() && index_ < vec_->size())
+                leafBegin_ = vec_->locate(index_, leaf_);
+            return *this;
+        }
+
+        bool operator==(const const_iterator &rhs) const
+        {
+            return index_ == rhs.index_;
+        }
+
+      private:
+        friend class PersistentVector;
+
+        const_iterator(const PersistentVector *vec, size_t index) : vec_(vec), index_(index)
+        {
+            if (index_ < vec_->size())
+                leafBegin_ = vec_->locate(index_, leaf_);
+        }
+
+        const PersistentVector *vec_;
+        size_t index_;
+        const Node *leaf_ = nullptr;
+        size_t leafBegin_ = 0;
+    };
+
+  public:
+    PersistentVector() = default;
+
+    explicit PersistentVector(size_t count, const T &val = T())
+    {
+        build(std::vector<T>(count, val));
+    }
+
+    PersistentVector(std::initializer_list<T> init)
+    {
+        build(std::vector<T>(init));
+    }
+
+    explicit PersistentVector(const std::vector<T> &vec)
+    {
+        build(vec);
+    }
+
+    size_t size() const
+    {
+        return root_ ? root_->size_ : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const T &operator[](size_t index) const
+    {
+        const Node *leaf = nullptr;
+        size_t begin = locate(index, leaf);
+        return leaf->values_[index - begin];
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, size());
+    }
+
+    // 按顺序把每个叶子的元素交给fn(const T *data, size_t count)
+    template <typename Fn>
+    void forEachChunk(Fn &&fn) const
+    {
+        if (root_)
+            forEachChunk(root_.get(), fn);
+    }
+
+    std::vector<T> toVector() const
+    {
+        std::vector<T> vec;
+        vec.reserve(size());
+        forEachChunk([&](const T *data, size_t count) { vec.insert(vec.end(), data, data + count); });
+        return vec;
+    }
+
+    bool operator==(const std::vector<T> &rhs) const
+    {
+        if (size() != rhs.size())
+            return false;
+        bool equal = true;
+        auto iter = rhs.begin();
+        forEachChunk([&](const T *data, size_t count) {
+            equal = equal && std::equal(data, data + count, iter);
+            iter += count;
+        });
+        return equal;
+    }
+
+    bool operator==(const PersistentVector &rhs) const
+    {
+        return root_ == rhs.root_ || *this == rhs.toVector();
+    }
+
+    // 两份是否还共享同一个根, 用来确认拷贝没有复制数据
+    bool sharesRoot(const PersistentVector &rhs) const
+    {
+        return root_ == rhs.root_;
+    }
+
+    void set(size_t index, T val)
+    {
+        assert(index < size());
+        Node *node = mutate(root_);
+        while (!node->leaf_)
+        {
+            size_t child = childOf(node, index);
+            node = mutate(node->children_[child]);
+        }
+        node->values_[index] = std::move(val);
+    }
+
+    void insert(size_t index, T val)
+    {
+        assert(index <= size());
+        if (!root_)
+        {
+            root_ = std::make_shared<Node>();
+            root_->leaf_ = true;
+        }
+        NodePtr sibling = insertAt(root_, index, std::move(val));
+        if (sibling)
+        {
+            NodePtr root = std::make_shared<Node>();
+            root->size_ = root_->size_ + sibling->size_;
+            root->sizes_ = {root_->size_, sibling->size_};
+            root->children_ = {std::move(root_), std::move(sibling)};
+            root_ = std::move(root);
+        }
+    }
+
+    void erase(size_t index)
+    {
+        assert(index < size());
+        eraseAt(root_, index);
+        while (!root_->leaf_ && root_->children_.size() == 1)
+            root_ = NodePtr(root_->children_.front());
+        if (!root_->size_)
+            root_.reset();
+    }
+
+    void clear()
+    {
+        root_.reset();
+    }
+
+  private:
+    struct Node
+    {
+        bool leaf_ = false;
+        size_t size_ = 0;
+        std::vector<T> values_;         // leaf
+        std::vector<NodePtr> children_; // branch
+        std::vector<size_t> sizes_;     // branch, size of each child
+
+        size_t width() const
+        {
+            return leaf_ ? values_.size() : children_.size();
+        }
+
+        size_t maxWidth() const
+        {
+            return leaf_ ? LeafMax : BranchMax;
+        }
+    };
+
+    // 别的拷贝也引用这个节点时先复制一份, 复制出来的节点的孩子因此都变成共享的, 再往下改时也会被复制
+    static Node *mutate(NodePtr &node)
+    {
+        if (node.use_count() != 1)
+            node = std::make_shared<Node>(*node);
+        else
+            std::atomic_thread_fence(std::memory_order_acquire); // 其他线程刚释放的引用
+        return node.get();
+    }
+
+    // index所在的孩子, index改成在孩子里的下标
+    static size_t childOf(const Node *node, size_t &index)
+    {
+        size_t child = 0;
+        while (index >= node->sizes_[child])
+            index -= node->sizes_[child++];
+        return child;
+    }
+
+    // 返回index所在叶子第一个元素的下标
+    size_t locate(size_t index, const Node *&leaf) const
+    {
+        size_t begin = index;
+        const Node *node = root_.get();
+        while (!node->leaf_)
+            node = node->children_[childOf(node, index)].get();
+        leaf = node;
+        return begin - index;
+    }
+
+    template <typename Fn>
+    static void forEachChunk(const Node *node, Fn &fn)
+    {
+        if (node->leaf_)
+        {
+            fn(node->values_.data(), node->values_.size());
+            return;
+        }
+        for (auto &&child : node->children_)
+            forEachChunk(child.get(), fn);
+    }
+
+    // 节点超过上限时从中间分开, 返回右半边
+    static NodePtr split(Node *node)
+    {
+        NodePtr right = std::make_shared<Node>();
+        right->leaf_ = node->leaf_;
+        size_t half = node->width() / 2;
+        if (node->leaf_)
+        {
+            right->values_.assign(std::make_move_iterator(node->values_.begin() + half),
+                                  std::make_move_iterator(node->values_.end()));
+            node->values_.resize(half);
+            right->size_ = right->values_.size();
+        }
+        else
+        {
+            right->children_.assign(node->children_.begin() + half, node->children_.end());
+            right->sizes_.assign(node->sizes_.begin() + half, node->sizes_.end());
+            node->children_.resize(half);
+            node->sizes_.resize(half);
+            for (size_t size : right->sizes_)
+                right->size_ += size;
+        }
+        node->size_ -= right->size_;
+        return right;
+    }
+
+    static NodePtr insertAt(NodePtr &ptr, size_t index, T &&val)
+    {
+        Node *node = mutate(ptr);
+        node->size_++;
+        if (node->leaf_)
+        {
+            node->values_.insert(node->values_.begin() + index, std::move(val));
+        }
+        else
+        {
+            size_t child = node->children_.size() - 1;
+            if (index < node->size_ - 1)
+                child = childOf(node, index);
+            else
+                index -= node->size_ - 1 - node->sizes_.back();
+            NodePtr sibling = insertAt(node->children_[child], index, std::move(val));
+            node->sizes_[child] = node->children_[child]->size_;
+            if (sibling)
+            {
+                node->sizes_.insert(node->sizes_.begin() + child + 1, sibling->size_);
+                node->children_.insert(node->children_.begin() + child + 1, std::move(sibling));
+            }
+        }
+        return node->width() > node->maxWidth() ? split(node) : nullptr;
+    }
+
+    static void eraseAt(NodePtr &ptr, size_t index)
+    {
+        Node *node = mutate(ptr);
+        node->size_--;
+        if (node->leaf_)
+        {
+            node->values_.erase(node->values_.begin() + index);
+            return;
+        }
+
+        size_t child = childOf(node, index);
+        eraseAt(node->children_[child], index);
+        node->sizes_[child]--;
+        if (!node->sizes_[child])
+        {
+            node->children_.erase(node->children_.begin() + child);
+            node->sizes_.erase(node->sizes_.begin() + child);
+            return;
+        }
+        if (node->children_[child]->width() < node->children_[child]->maxWidth() / 2)
+            rebalance(node, child);
+    }
+
+    // 变小的孩子和一个邻居合起来不超过上限时合并, 保证相邻的两个孩子至少有一个过半
+    static void rebalance(Node *node, size_t child)
+    {
+        size_t left = child, right = child + 1;
+        if (right == node->children_.size() ||
+            (child > 0 && node->children_[child - 1]->width() < node->children_[right]->width()))
+        {
+            if (child == 0)
+                return;
+            left = child - 1;
+            right = child;
+        }
+        const Node *rightNode = node->children_[right].get();
+        if (node->children_[left]->width() + rightNode->width() > rightNode->maxWidth())
+            return;
+
+        Node *leftNode = mutate(node->children_[left]);
+        if (leftNode->leaf_)
+        {
+            leftNode->values_.insert(leftNode->values_.end(), rightNode->values_.begin(), rightNode->values_.end());
+        }
+        else
+        {
+            leftNode->children_.insert(leftNode->children_.end(), rightNode->children_.begin(),
+                                       rightNode->children_.end());
+            leftNode->sizes_.insert(leftNode->sizes_.end(), rightNode->sizes_.begin(), rightNode->sizes_.end());
+        }
+        leftNode->size_ += rightNode->size_;
+        node->sizes_[left] = leftNode->size_;
+        node->children_.erase(node->children_.begin() + right);
+        node->sizes_.erase(node->sizes_.begin() + right);
+    }
+
+    // 叶子装到3/4, 留一些空间给之后的插入
+    void build(const std::vector<T> &vec)
+    {
+        root_.reset();
+        if (vec.empty())
+            return;
+
+        std::vector<NodePtr> level;
+        for (size_t begin = 0; begin < vec.size(); begin += LeafMax * 3 / 4)
+        {
+            NodePtr leaf = std::make_shared<Node>();
+            leaf->leaf_ = true;
+            leaf->values_.assign(vec.begin() + begin, vec.begin() + std::min(vec.size(), begin + LeafMax * 3 / 4));
+            leaf->size_ = leaf->values_.size();
+            level.emplace_back(std::move(leaf));
+        }
+        while (level.size() > 1)
+        {
+            std::vector<NodePtr> parents;
+            for (size_t begin = 0; begin < level.size(); begin += BranchMax * 3 / 4)
+            {
+                NodePtr parent = std::make_shared<Node>();
+                for (size_t i = begin; i < std::min(level.size(), begin + BranchMax * 3 / 4); ++i)
+                {
+                    parent->size_ += level[i]->size_;
+                    parent->sizes_.emplace_back(level[i]->size_);
+                    parent->children_.emplace_back(std::move(level[i]));
+                }
+                parents.emplace_back(std::move(parent));
+            }
+            level.swap(parents);
+        }
+        root_ = std::move(level.front());
+    }
+
+    NodePtr root_;
+};
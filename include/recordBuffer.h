@@ -0,0 +1,373 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+// 内联部分的存储, 容量为0时不占空间
+template <typename T, size_t N>
+struct InlineStorage
+{
+    T *data()
+    {
+        return reinterpret_cast<T *>(buf_);
+    }
+
+    const T *data() const
+    {
+        return reinterpret_cast<const T *>(buf_);
+    }
+
+    alignas(T) std::byte buf_[N * sizeof(T)];
+};
+
+template <typename T>
+struct InlineStorage<T, 0>
+{
+    T *data()
+    {
+        return nullptr;
+    }
+
+    const T *data() const
+    {
+        return nullptr;
+    }
+};
+
+// 存一个commit的ModifyRecord, 接口是std::vector的一个子集
+// 小记录(整数的新旧值这种)的前几条放在对象自己里面, 只有一两条记录的事务不用分配内存;
+// 大记录不内联, 否则打包之后的冷commit也要一直背着这块空间. 放不下时搬到堆上按2倍增长,
+// clear()保留堆上的容量, 配合NodePool复用; 长度用32位, 不内联时比std::vector还小8个字节,
+// 和std::vector一样超过max_size()时抛std::length_error
+template <typename T>
+class RecordBuffer
+{
+  public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    static constexpr size_t InlineBytes = 16;
+    static constexpr size_t InlineCapacity = sizeof(T) <= InlineBytes ? InlineBytes / sizeof(T) : 0;
+
+  public:
+    RecordBuffer() = default;
+
+    RecordBuffer(const RecordBuffer &rhs)
+    {
+        reserve(rhs.size_);
+        std::uninitialized_copy(rhs.begin(), rhs.end(), data_);
+        size_ = rhs.size_;
+    }
+
+    RecordBuffer(RecordBuffer &&rhs) noexcept
+    {
+        steal(rhs);
+    }
+
+    RecordBuffer &operator=(const RecordBuffer &rhs)
+    {
+        if (this != &rhs)
+        {
+            clear();
+            reserve(rhs.size_);
+            std::uninitialized_copy(rhs.begin(), rhs.end(), data_);
+            size_ = rhs.size_;
+        }
+        return *this;
+    }
+
+    // rhs在堆上时直接接管它的内存, 自己原来的堆内存释放掉
+    RecordBuffer &operator=(RecordBuffer &&rhs) noexcept
+    {
+        if (this == &rhs)
+            return *this;
+        clear();
+        if (!rhs.isInline() || isInline())
+        {
+            deallocate();
+            steal(rhs);
+        }
+        else
+        {
+            std::uninitialized_move(rhs.begin(), rhs.end(), data_);
+            size_ = rhs.size_;
+            rhs.clear();
+        }
+        return *this;
+    }
+
+    ~RecordBuffer()
+    {
+        clear();
+        deallocate();
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    static constexpr size_t max_size()
+    {
+        return std::numeric_limits<uint32_t>::max();
+    }
+
+    // 堆上分配的字节数, 内联的部分算在对象自己的大小里
+    size_t heapBytes() const
+    {
+        return isInline() ? 0 : capacity_ * sizeof(T);
+    }
+
+    T *data()
+    {
+        return data_;
+    }
+
+    const T *data() const
+    {
+        return data_;
+    }
+
+    iterator begin()
+    {
+        return data_;
+    }
+
+    iterator end()
+    {
+        return data_ + size_;
+    }
+
+    const_iterator begin() const
+    {
+        return data_;
+    }
+
+    const_iterator end() const
+    {
+        return data_ + size_;
+    }
+
+    reverse_iterator rbegin()
+    {
+        return reverse_iterator(end());
+    }
+
+    reverse_iterator rend()
+    {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rbegin() const
+    {
+        return const_reverse_iterator(end());
+    }
+
+    const_reverse_iterator rend() const
+    {
+        return const_reverse_iterator(begin());
+    }
+
+    T &operator[](size_t index)
+    {
+        return data_[index];
+    }
+
+    const T &operator[](size_t index) const
+    {
+        return data_[index];
+    }
+
+    T &front()
+    {
+        return data_[0];
+    }
+
+    const T &front() const
+    {
+        return data_[0];
+    }
+
+    T &back()
+    {
+        return data_[size_ - 1];
+    }
+
+    const T &back() const
+    {
+        return data_[size_ - 1];
+    }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity > max_size())
+            throw std::length_error("RecordBuffer::reserve");
+        if (capacity > capacity_)
+            reallocate(capacity);
+    }
+
+    // 参数可能引用自己里面的元素, 先在新内存上构造新元素再搬旧的
+    template <typename... Args>
+    T &emplace_back(Args &&...args)
+    {
+        if (size_ < capacity_)
+            return *std::construct_at(data_ + size_++, std::forward<Args>(args)...);
+
+        if (size_ == max_size())
+            throw std::length_error("RecordBuffer::emplace_back");
+        size_t capacity = capacity_ ? std::min<size_t>(size_t(capacity_) * 2, max_size()) : 1;
+        T *buf = allocate(capacity);
+        std::construct_at(buf + size_, std::forward<Args>(args)...);
+        std::uninitialized_move(begin(), end(), buf);
+        std::destroy(begin(), end());
+        deallocate();
+        data_ = buf;
+        capacity_ = capacity;
+        return data_[size_++];
+    }
+
+    void push_back(const T &val)
+    {
+        emplace_back(val);
+    }
+
+    void push_back(T &&val)
+    {
+        emplace_back(std::move(val));
+    }
+
+    void pop_back()
+    {
+        std::destroy_at(data_ + --size_);
+    }
+
+    iterator erase(iterator first, iterator last)
+    {
+        if (first == last)
+            return first;
+        iterator newEnd = std::move(last, end(), first);
+        std::destroy(newEnd, end());
+        size_ = newEnd - begin();
+        return first;
+    }
+
+    void clear()
+    {
+        std::destroy(begin(), end());
+        size_ = 0;
+    }
+
+    // 放不进内联部分时按size重新分配, 用在冷历史这种不会再增长的地方
+    void shrink_to_fit()
+    {
+        if (isInline() || size_ == capacity_)
+            return;
+        if (size_ > InlineCapacity)
+        {
+            reallocate(size_);
+            return;
+        }
+        T *buf = data_;
+        data_ = inlineData();
+        capacity_ = InlineCapacity;
+        std::uninitialized_move(buf, buf + size_, data_);
+        std::destroy(buf, buf + size_);
+        ::operator delete(buf, std::align_val_t(alignof(T)));
+    }
+
+    // 两边都在堆上时只交换指针
+    void swap(RecordBuffer &rhs) noexcept
+    {
+        if (!isInline() && !rhs.isInline())
+        {
+            std::swap(data_, rhs.data_);
+            std::swap(size_, rhs.size_);
+            std::swap(capacity_, rhs.capacity_);
+            return;
+        }
+        RecordBuffer tmp(std::move(rhs));
+        rhs = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+  private:
+    bool isInline() const
+    {
+        return data_ == inlineData();
+    }
+
+    T *inlineData()
+    {
+        return inline_.data();
+    }
+
+    const T *inlineData() const
+    {
+        return inline_.data();
+    }
+
+    static T *allocate(size_t capacity)
+    {
+        return static_cast<T *>(::operator new(capacity * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate()
+    {
+        if (!isInline())
+            ::operator delete(data_, std::align_val_t(alignof(T)));
+        data_ = inlineData();
+        capacity_ = InlineCapacity;
+    }
+
+    void reallocate(size_t capacity)
+    {
+        T *buf = allocate(capacity);
+        std::uninitialized_move(begin(), end(), buf);
+        std::destroy(begin(), end());
+        deallocate();
+        data_ = buf;
+        capacity_ = capacity;
+    }
+
+    // 自己是空的并且没有堆内存, rhs留下一个空的内联buffer
+    void steal(RecordBuffer &rhs) noexcept
+    {
+        if (rhs.isInline())
+        {
+            std::uninitialized_move(rhs.begin(), rhs.end(), data_);
+            size_ = rhs.size_;
+            rhs.clear();
+            return;
+        }
+        data_ = rhs.data_;
+        size_ = rhs.size_;
+        capacity_ = rhs.capacity_;
+        rhs.data_ = rhs.inlineData();
+        rhs.size_ = 0;
+        rhs.capacity_ = InlineCapacity;
+    }
+
+    T *data_ = inlineData();
+    uint32_t size_ = 0;
+    uint32_t capacity_ = InlineCapacity;
+    [[no_unique_address]] InlineStorage<T, InlineCapacity> inline_;
+};
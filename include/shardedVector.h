@@ -0,0 +1,319 @@
+#pragma once
+#include "atomicVector.h"
+#include "transInterface.h"
+#include <algorithm>
+#include <assert.h>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// 分成几段的vector, 每个分片是一个独立的TransInterface<std::vector<T>>, 有自己的锁和历史
+// 事务在beginTransaction时声明要写的分片, 按分片下标从小到大加锁, 只碰不同分片的事务可以同时进行
+// 跨分片的事务是两阶段的: 先锁住并在每个分片上beginTransaction, endTransaction在所有分片都提交之后才一起放锁,
+// 其他线程看不到只提交了一半的事务; undo/redo也是所有分片一起, 做不到就什么都不改
+// 同一个线程不能同时开着两个分片有重叠的事务
+template <typename T>
+class ShardedVector
+{
+  public:
+    typedef std::vector<T> ValueType;
+    typedef TransInterface<ValueType> ShardType;
+    typedef typename ShardType::ModifyType ModifyType;
+    typedef size_t CommitId;
+
+    static constexpr CommitId EmptyTransaction = std::numeric_limits<size_t>::max();
+
+    // 只属于一个线程, 析构时还开着就abort
+    class Transaction
+    {
+      public:
+        Transaction(Transaction &&rhs) noexcept
+            : owner_(std::exchange(rhs.owner_, nullptr)), shards_(std::move(rhs.shards_)),
+              modified_(std::move(rhs.modified_))
+        {
+        }
+
+        Transaction &operator=(Transaction &&) = delete;
+
+        ~Transaction()
+        {
+            if (owner_)
+                owner_->abortTransaction(*this);
+        }
+
+        // 参数和TransInterface<std::vector<T>>::modify一样, 下标是分片里的下标
+        // shard不是beginTransaction时声明的分片, 或者修改没有生效(Fail)时返回false, 分片不算改过
+        template <typename... Args>
+        bool modify(size_t shard, ModifyType type, Args &&...args)
+        {
+            size_t slot = slotOf(shard);
+            if (slot == shards_.size())
+                return false;
+            if (!owner_->shards_[shard]->atom_.modify(type, std::forward<Args>(args)...))
+                return false;
+            modified_[slot] = true;
+            return true;
+        }
+
+        // 包含这个事务自己的修改
+        const ValueType &get(size_t shard) const
+        {
+            assert(holds(shard));
+            return owner_->shards_[shard]->atom_.get();
+        }
+
+        bool holds(size_t shard) const
+        {
+            return slotOf(shard) != shards_.size();
+        }
+
+        bool active() const
+        {
+            return owner_ != nullptr;
+        }
+
+      private:
+        friend class ShardedVector;
+
+        Transaction(ShardedVector *owner, RecordBuffer<size_t> shards) : owner_(owner), shards_(std::move(shards))
+        {
+            for (size_t i = 0; i < shards_.size(); ++i)
+                modified_.push_back(0);
+        }
+
+        size_t slotOf(size_t shard) const
+        {
+            auto iter = std::lower_bound(shards_.begin(), shards_.end(), shard);
+            return iter != shards_.end() && *iter == shard ? iter - shards_.begin() : shards_.size();
+        }
+
+        ShardedVector *owner_;
+        RecordBuffer<size_t> shards_;    // 从小到大, 没有重复, 都已经锁住
+        RecordBuffer<uint8_t> modified_; // 和shards_一一对应
+    };
+
+  public:
+    explicit ShardedVector(std::vector<ValueType> shards)
+    {
+        shards_.reserve(shards.size());
+        for (auto &val : shards)
+            shards_.emplace_back(std::make_unique<Shard>(std::move(val)));
+    }
+
+    ShardedVector(size_t shardCount, size_t shardSize, const T &val = T())
+        : ShardedVector(std::vector<ValueType>(shardCount, ValueType(shardSize, val)))
+    {
+    }
+
+    ShardedVector(const ShardedVector &) = delete;
+    ShardedVector &operator=(const ShardedVector &) = delete;
+
+    size_t shardCount() const
+    {
+        return shards_.size();
+    }
+
+    // 别的线程可能正在写, 拿锁拷贝一份
+    ValueType get(size_t shard) const
+    {
+        std::lock_guard<std::mutex> lock(shards_[shard]->mutex_);
+        return shards_[shard]->atom_.get();
+    }
+
+    // 每个分片的历史都用这个retention policy, 默认不限
+    void setRetentionPolicy(const typename ShardType::RetentionPolicy &policy)
+    {
+        for (auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex_);
+            shard->atom_.setRetentionPolicy(policy);
+            shard->sync();
+        }
+    }
+
+    // 按下标从小到大加锁, 所以几个线程各自锁多个分片也不会死锁
+    Transaction beginTransaction(std::initializer_list<size_t> shards)
+    {
+        return begin(shards.begin(), shards.end());
+    }
+
+    Transaction beginTransaction(const std::vector<size_t> &shards)
+    {
+        return begin(shards.begin(), shards.end());
+    }
+
+    Transaction beginTransaction(size_t shard)
+    {
+        return begin(&shard, &shard + 1);
+    }
+
+    // 改过的分片逐个endTransaction, 全部提交之后才放锁; 没改过的分片abort掉, 不留空的commit
+    // 返回的id给undo/redo用, 一个分片都没改过时返回EmptyTransaction
+    // id由改过的第一个分片自己的计数分配, 不同分片上的事务不碰同一个计数器
+    CommitId endTransaction(Transaction &tx)
+    {
+        if (!tx.owner_)
+            return EmptyTransaction;
+
+        uint32_t touched = 0;
+        CommitId id = EmptyTransaction;
+        for (size_t i = 0; i < tx.shards_.size(); ++i)
+        {
+            if (!tx.modified_[i])
+                continue;
+            if (!touched++)
+                id = shards_[tx.shards_[i]]->nextId_++ * shards_.size() + tx.shards_[i];
+        }
+        for (size_t i = 0; i < tx.shards_.size(); ++i)
+        {
+            Shard &shard = *shards_[tx.shards_[i]];
+            if (!tx.modified_[i])
+            {
+                shard.atom_.abortTransaction();
+                continue;
+            }
+            shard.atom_.endTransaction();
+            shard.done_.push_back(Entry{id, touched});
+            shard.sync();
+        }
+        release(tx);
+        return id;
+    }
+
+    void abortTransaction(Transaction &tx)
+    {
+        if (!tx.owner_)
+            return;
+        for (size_t shard : tx.shards_)
+            shards_[shard]->atom_.abortTransaction();
+        release(tx);
+    }
+
+    // fn(tx)
+    template <typename Fn>
+    CommitId transact(std::initializer_list<size_t> shards, Fn &&fn)
+    {
+        Transaction tx = beginTransaction(shards);
+        fn(tx);
+        return endTransaction(tx);
+    }
+
+    // 在id改过的所有分片上一起undo; 其中有分片在id之后又提交过, 或者id不能undo时返回false, 什么都不改
+    bool undo(CommitId id)
+    {
+        return revert(id, true);
+    }
+
+    // undo(id)之后没有分片再提交过时才能redo
+    bool redo(CommitId id)
+    {
+        return revert(id, false);
+    }
+
+  private:
+    struct Entry
+    {
+        CommitId id_;
+        uint32_t shards_; // 这个事务改过几个分片
+    };
+
+    // 各自一块缓存行, 不同分片的锁不会互相干扰
+    struct alignas(64) Shard
+    {
+        explicit Shard(ValueType val) : atom_(std::move(val))
+        {
+        }
+
+        // atom_每次提交/undo/redo之后调用: 新的提交清空了redo栈, retention从栈底挤掉了commit, 两边跟着去掉
+        void sync()
+        {
+            while (done_.size() > atom_.undoDepth())
+                done_.pop_front();
+            while (undone_.size() > atom_.redoDepth())
+                undone_.pop_front();
+        }
+
+        // atom_拒绝时返回false, 什么都不改
+        bool step(bool undo)
+        {
+            if (!(undo ? atom_.undo() : atom_.redo()))
+                return false;
+            std::deque<Entry> &from = undo ? done_ : undone_;
+            (undo ? undone_ : done_).push_back(from.back());
+            from.pop_back();
+            sync();
+            return true;
+        }
+
+        mutable std::mutex mutex_;
+        ShardType atom_;
+        CommitId nextId_ = 0;
+        std::deque<Entry> done_;   // 和atom_的undo栈一一对应
+        std::deque<Entry> undone_; // 和atom_的redo栈一一对应
+    };
+
+    template <typename Iter>
+    Transaction begin(Iter first, Iter last)
+    {
+        RecordBuffer<size_t> shards;
+        for (; first != last; ++first)
+            shards.push_back(*first);
+        std::sort(shards.begin(), shards.end());
+        shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+        assert(shards.empty() || shards.back() < shards_.size());
+        for (size_t shard : shards)
+        {
+            shards_[shard]->mutex_.lock();
+            shards_[shard]->atom_.beginTransaction();
+        }
+        return Transaction(this, std::move(shards));
+    }
+
+    // 锁住全部分片, id在每个改过的分片上都要在栈顶
+    bool revert(CommitId id, bool undo)
+    {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(shards_.size());
+        std::vector<Shard *> hit;
+        uint32_t expected = 0;
+        for (auto &shard : shards_)
+        {
+            locks.emplace_back(shard->mutex_);
+            if (undo ? !shard->done_.empty() && shard->done_.back().id_ == id
+                     : !shard->undone_.empty() && shard->undone_.back().id_ == id)
+            {
+                expected = undo ? shard->done_.back().shards_ : shard->undone_.back().shards_;
+                hit.push_back(shard.get());
+            }
+        }
+        if (hit.empty() || hit.size() != expected)
+            return false;
+
+        for (size_t i = 0; i < hit.size(); ++i)
+        {
+            if (hit[i]->step(undo))
+                continue;
+            // 前面已经做了的分片反着做回去
+            while (i-- > 0)
+                hit[i]->step(!undo);
+            return false;
+        }
+        return true;
+    }
+
+    void release(Transaction &tx)
+    {
+        for (auto iter = tx.shards_.rbegin(); iter != tx.shards_.rend(); ++iter)
+            shards_[*iter]->mutex_.unlock();
+        tx.owner_ = nullptr;
+        tx.shards_.clear();
+        tx.modified_.clear();
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_DIFF_X86 1
+#endif
+
+// 按字节比较两块内存, 给diff找第一个不同的位置
+// x86上运行时选AVX2, 否则SSE2; 其他平台每次比8个字节
+
+// [0, bytes)里第一个不同字节的下标, 全部相同时返回bytes
+inline size_t mismatchBytesScalar(const char *a, const char *b, size_t bytes)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t))
+    {
+        uint64_t x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        if (x != y)
+        {
+            if constexpr (std::endian::native == std::endian::little)
+                return i + std::countr_zero(x ^ y) / 8;
+            else
+                return i + std::countl_zero(x ^ y) / 8;
+        }
+    }
+    for (; i < bytes; ++i)
+    {
+        if (a[i] != b[i])
+            return i;
+    }
+    return i;
+}
+
+#ifdef SIMD_DIFF_X86
+inline size_t mismatchBytesSse2(const char *a, const char *b, size_t bytes)
+{
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        unsigned equal = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+        if (equal != 0xffff)
+            return i + std::countr_zero(~equal);
+    }
+    return i + mismatchBytesScalar(a + i, b + i, bytes - i);
+}
+
+// 一次比64个字节, 两半的比较结果合起来只判断一次
+__attribute__((target("avx2"))) inline size_t mismatchBytesAvx2(const char *a, const char *b, size_t bytes)
+{
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64)
+    {
+        __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+                                       _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 32)),
+                                       _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 32)));
+        if (_mm256_movemask_epi8(_mm256_and_si256(lo, hi)) != -1)
+        {
+            uint64_t equal = static_cast<uint32_t>(_mm256_movemask_epi8(lo)) |
+                             static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hi))) << 32;
+            return i + std::countr_zero(~equal);
+        }
+    }
+    return i + mismatchBytesSse2(a + i, b + i, bytes - i);
+}
+#endif
+
+// 和mismatchBytesScalar一样, 用当前CPU最快的实现
+inline size_t mismatchBytes(const char *a, const char *b, size_t bytes)
+{
+#ifdef SIMD_DIFF_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2 ? mismatchBytesAvx2(a, b, bytes) : mismatchBytesSse2(a, b, bytes);
+#else
+    return mismatchBytesScalar(a, b, bytes);
+#endif
+}
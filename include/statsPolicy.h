@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// TransInterface的统计策略
+// compiled == false时连计时一起在编译期去掉; 只在写线程更新, 任何线程都可以读
+struct NoStats
+{
+    static constexpr bool compiled = false;
+
+    uint64_t startTimer()
+    {
+        return 0;
+    }
+
+    void onRecord()
+    {
+    }
+
+    void onEndTransaction(uint64_t)
+    {
+    }
+
+    void onUndo(uint64_t)
+    {
+    }
+
+    void onRedo(uint64_t)
+    {
+    }
+
+    void onAbort(uint64_t)
+    {
+    }
+};
+
+// 只有一个线程写, 不需要带lock的读改写
+inline void bumpCounter(std::atomic<uint64_t> &counter, uint64_t delta = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+// 对数分桶的延迟直方图, 每个2的幂区间再等分成SubBuckets份, 相对误差不超过1/SubBuckets
+// 小于SubBuckets的值每个值一个桶; 只能有一个线程record, 读的线程看到的各项之间可能差一次record
+class LatencyHistogram
+{
+  public:
+    static constexpr size_t SubBuckets = 16;
+    static constexpr size_t BucketCount = (64 - std::bit_width(SubBuckets) + 2) * SubBuckets;
+
+    void record(uint64_t value)
+    {
+        bumpCounter(buckets_[bucketOf(value)]);
+        bumpCounter(count_);
+        bumpCounter(sum_, value);
+        if (value > max_.load(std::memory_order_relaxed))
+            max_.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    double mean() const
+    {
+        uint64_t count = this->count();
+        return count ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count : 0;
+    }
+
+    // q在[0, 1]之间, 返回第q分位所在桶的上界, 不超过max()
+    uint64_t percentile(double q) const
+    {
+        uint64_t count = this->count();
+        if (!count)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(bucketUpper(i), max());
+        }
+        return max();
+    }
+
+    void reset()
+    {
+        for (auto &bucket : buckets_)
+            bucket.store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr size_t SubBits = std::bit_width(SubBuckets) - 1;
+
+    static size_t bucketOf(uint64_t value)
+    {
+        if (value < SubBuckets)
+            return value;
+        size_t shift = std::bit_width(value) - SubBits - 1;
+        return (shift + 1) * SubBuckets + (value >> shift) - SubBuckets;
+    }
+
+    static uint64_t bucketUpper(size_t bucket)
+    {
+        if (bucket < SubBuckets)
+            return bucket;
+        size_t shift = bucket / SubBuckets - 1;
+        uint64_t sub = bucket % SubBuckets + SubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> buckets_[BucketCount] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// 计数和endTransaction/undo/redo/abortTransaction的延迟(纳秒), 嵌套事务也算
+// 读时钟比一次简单的commit还贵, 默认每DefaultSampleRate次操作计一次时, 计数不受影响
+struct TransStats
+{
+    static constexpr bool compiled = true;
+    static constexpr uint64_t DefaultSampleRate = 8;
+
+    // 每rate次操作计一次时, rate向上取成2的幂, 1表示每次都计时
+    void setSampleRate(uint64_t rate)
+    {
+        sampleMask_ = std::bit_ceil(std::max<uint64_t>(rate, 1)) - 1;
+    }
+
+    // 不计时的操作返回0
+    uint64_t startTimer()
+    {
+        return (ticks_++ & sampleMask_) ? 0 : now();
+    }
+
+    void onRecord()
+    {
+        bumpCounter(records_);
+    }
+
+    void onEndTransaction(uint64_t start)
+    {
+        bumpCounter(commits_);
+        if (start)
+            endTransaction_.record(now() - start);
+    }
+
+    void onUndo(uint64_t start)
+    {
+        bumpCounter(undos_);
+        if (start)
+            undo_.record(now() - start);
+    }
+
+    void onRedo(uint64_t start)
+    {
+        bumpCounter(redos_);
+        if (start)
+            redo_.record(now() - start);
+    }
+
+    void onAbort(uint64_t start)
+    {
+        bumpCounter(aborts_);
+        if (start)
+            abort_.record(now() - start);
+    }
+
+    void reset()
+    {
+        commits_.store(0, std::memory_order_relaxed);
+        undos_.store(0, std::memory_order_relaxed);
+        redos_.store(0, std::memory_order_relaxed);
+        aborts_.store(0, std::memory_order_relaxed);
+        records_.store(0, std::memory_order_relaxed);
+        endTransaction_.reset();
+        undo_.reset();
+        redo_.reset();
+        abort_.reset();
+    }
+
+    std::atomic<uint64_t> commits_{0};
+    std::atomic<uint64_t> undos_{0}; // 栈空时的undo/redo不算
+    std::atomic<uint64_t> redos_{0};
+    std::atomic<uint64_t> aborts_{0};
+    std::atomic<uint64_t> records_{0};
+    LatencyHistogram endTransaction_;
+    LatencyHistogram undo_;
+    LatencyHistogram redo_;
+    LatencyHistogram abort_;
+
+  private:
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    uint64_t ticks_ = 0;
+    uint64_t sampleMask_ = DefaultSampleRate - 1;
+};
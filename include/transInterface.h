@@ -1,38 +1,42 @@
 #pragma once
 
 #include "atomicInterface.h"
+#include "journal.h"
+#include "logPolicy.h"
+#include "nodePool.h"
+#include "statsPolicy.h"
+#include <algorithm>
 #include <assert.h>
-#include <iostream>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
-static bool globalLogEnable = false;
-
+// 只能在TransInterface内部使用, 日志关闭时右边的表达式不会求值
 #define LOG                                                                                                            \
-    if (globalLogEnable)                                                                                               \
-    std::cout
-
-void disableLog()
-{
-    globalLogEnable = false;
-}
-
-void enableLog()
-{
-    globalLogEnable = true;
-}
+    if (!logEnabled())                                                                                                 \
+    {                                                                                                                  \
+    }                                                                                                                  \
+    else                                                                                                               \
+        logPolicy_.stream()
 
-template <typename Tp>
+template <typename Tp, typename LogPolicy = NoLog, typename StatsPolicy = NoStats>
 class TransInterface : private AtomInterface<Tp>
 {
   public:
     typedef AtomInterface<Tp> BaseType;
     using typename BaseType::ModifyRecord;
     using typename BaseType::ModifyType;
+    using typename BaseType::Snapshot;
     using typename BaseType::ValueType;
 
   public:
@@ -41,8 +45,53 @@ class TransInterface : private AtomInterface<Tp>
     {
     }
 
+    // 限制顶层历史的大小, 超出后最老的已提交commit连同子事务一起丢弃, 不再能undo
+    struct RetentionPolicy
+    {
+        size_t maxUndoDepth_ = std::numeric_limits<size_t>::max();
+        size_t maxHistoryBytes_ = std::numeric_limits<size_t>::max();
+
+        bool unlimited() const
+        {
+            return maxUndoDepth_ == std::numeric_limits<size_t>::max() &&
+                   maxHistoryBytes_ == std::numeric_limits<size_t>::max();
+        }
+    };
+
+    // 每隔一些顶层操作或者一些新增历史就给当前值拍一个checkpoint
+    // resetTo从最近的checkpoint开始倒退, 打开journal时从snapshot开始重放
+    struct CheckpointPolicy
+    {
+        size_t everyCommits_ = std::numeric_limits<size_t>::max(); // top-level end/undo/redo
+        size_t everyBytes_ = std::numeric_limits<size_t>::max();   // history bytes added since the last checkpoint
+        size_t maxCheckpoints_ = 8;                                 // in memory, the oldest is dropped first
+    };
+
+    // root层undo/redo栈里离栈顶超过hotDepth_的commit是冷的, 整棵子树的记录编码成紧凑的字节
+    // 再被undo/redo/resetTo用到时解码回来, 需要原子实现packRecords/unpackRecords
+    struct CompactPolicy
+    {
+        size_t hotDepth_ = std::numeric_limits<size_t>::max();
+    };
+
+    // endTransaction时是否压缩记录
+    enum class CoalescePolicy
+    {
+        none,
+        records,           // 合并同一个目标上的modifyRecord, 有子事务时只合并最后一个子事务之后的
+        recordsAndChildren // 另外把已经结束的子事务按时间顺序折叠进这个commit
+    };
+
+    // 原子声明了CoalesceByDefault(合并很便宜)时默认合并记录
+    static constexpr CoalescePolicy DefaultCoalescePolicy = [] {
+        if constexpr (requires { requires BaseType::CoalesceByDefault; })
+            return CoalescePolicy::records;
+        else
+            return CoalescePolicy::none;
+    }();
+
   public:
-    class Commit;
+    struct Commit;
     enum class CommitTag
     {
         beginTrans,
@@ -52,66 +101,619 @@ class TransInterface : private AtomInterface<Tp>
     };
 
     typedef size_t CommitId;
-    typedef std::vector<std::shared_ptr<Commit>> Commits;
+    typedef std::vector<Commit *> Commits;
+
+    // vector加一个栈底下标, retention policy弹栈底时不用搬动整个栈
+    class CommitStack
+    {
+      public:
+        bool empty() const
+        {
+            return head_ == stack_.size();
+        }
+
+        size_t size() const
+        {
+            return stack_.size() - head_;
+        }
+
+        Commit *front() const
+        {
+            return stack_[head_];
+        }
+
+        Commit *back() const
+        {
+            return stack_.back();
+        }
+
+        void emplace_back(Commit *commit)
+        {
+            stack_.emplace_back(commit);
+        }
+
+        void pop_back()
+        {
+            stack_.pop_back();
+            if (empty())
+                clear();
+        }
+
+        void pop_front()
+        {
+            if (++head_ * 2 < stack_.size())
+                return;
+            stack_.erase(stack_.begin(), stack_.begin() + head_);
+            head_ = 0;
+        }
+
+        void clear()
+        {
+            stack_.clear();
+            head_ = 0;
+        }
+
+        auto begin() const
+        {
+            return stack_.begin() + head_;
+        }
+
+        auto end() const
+        {
+            return stack_.end();
+        }
+
+        auto rbegin() const
+        {
+            return stack_.rbegin();
+        }
 
+        auto rend() const
+        {
+            return stack_.rend() - head_;
+        }
+
+        Commit *operator[](size_t index) const
+        {
+            return stack_[head_ + index];
+        }
+
+      private:
+        std::vector<Commit *> stack_;
+        size_t head_ = 0;
+    };
+
+    // root和每个commit的children各自是一层, 每层自己维护undo/redo游标
+    // not-finished-commit -> 不会出现在栈里, 未完成的commit永远是curCommit_
+    // commit -> undo: commit
+    // commit undo -> undo: -, redo: undo
+    // commit undo redo -> undo: commit
+    // commit commit commit undo1 undo2 undo3 redo3 redo2 -> redo: undo1
+    struct Layer
+    {
+        Commits commits_;       // all commits of this layer in creation order
+        CommitStack undoStack_; // endTrans commits, top is the next one to undo
+        CommitStack redoStack_; // undo commits, top is the next one to redo
+
+        void clear()
+        {
+            commits_.clear();
+            undoStack_.clear();
+            redoStack_.clear();
+        }
+    };
+
+    // commit节点都在pool_里, 指针在commit被回收之前一直有效
     struct Commit
     {
-        CommitTag tag_;
+        CommitTag tag_ = CommitTag::beginTrans;
+        CommitId id_ = 0;
+        RecordBuffer<ModifyRecord> modifyRecords_;
+        Layer children_;           // recursive transaction
+        Commit *parent_ = nullptr; // nullptr -> root layer
+        Commit *target_ = nullptr; // undo -> the reverted endTrans commit, redo -> the reverted undo commit
+        size_t mark_ = 0;          // parent's record count when this commit was created, orders children in time
+        size_t bytes_ = 0;         // whole subtree, only maintained for closed top-level commits
+        bool retained_ = false;    // top-level commit still reachable from root undo/redo stack
+        bool packed_ = false;      // modifyRecords_ is empty, the records are in packedRecords_
+        size_t journalMark_ = 0;   // journalFrame_ size before this commit's begin event
+        std::string packedRecords_;
+
+        // 回收时保留vector的capacity
+        void reset()
+        {
+            tag_ = CommitTag::beginTrans;
+            id_ = 0;
+            modifyRecords_.clear();
+            children_.clear();
+            parent_ = nullptr;
+            target_ = nullptr;
+            mark_ = 0;
+            bytes_ = 0;
+            retained_ = false;
+            packed_ = false;
+            journalMark_ = 0;
+            packedRecords_.clear();
+        }
+    };
+
+    // root undoStack_里从最底下到depth_的commit都执行过之后的值, 栈顶是id_
+    // depth_从第一个commit算起, 被retention policy弹掉的也算, 这个位置上还是id_时才有效
+    struct Checkpoint
+    {
         CommitId id_;
-        std::vector<ModifyRecord> modifyRecords_;
-        std::shared_ptr<Commits> children_; // recursive transaction
-        std::weak_ptr<Commit> parent_;
+        size_t depth_;
+        ValueType value_;
     };
 
     static constexpr size_t EmptyTransaction = std::numeric_limits<size_t>::max();
 
-    std::shared_ptr<Commits> root_;
-    std::shared_ptr<Commit> curCommit_;
+    // 读线程看到的一个已提交版本, id_是产生它的顶层end/undo/redo commit, 还没有时是EmptyTransaction
+    struct Version
+    {
+        CommitId id_;
+        Snapshot value_;
+    };
+    typedef std::shared_ptr<const Version> VersionPtr;
+
+    // 写线程上的历史规模, depth按层从root开始, 后面是每个未结束事务的子事务层
+    struct HistoryStats
+    {
+        std::vector<size_t> undoDepths_;
+        std::vector<size_t> redoDepths_;
+        size_t historyBytes_ = 0;  // same as historyBytes()
+        size_t liveCommits_ = 0;   // commit nodes in use, including ones waiting for compaction
+        size_t pooledCommits_ = 0; // commit nodes allocated by the pool
+    };
+
+    NodePool<Commit> pool_;
+    Layer root_;
+    Commit *curCommit_ = nullptr;
     CommitId nextCommitId_;
+    RetentionPolicy retentionPolicy_;
+    size_t retainedBytes_ = 0;
+    size_t retainedCount_ = 0;
+    CoalescePolicy coalescePolicy_ = DefaultCoalescePolicy;
+    CompactPolicy compactPolicy_;
+    size_t rootEvicted_ = 0; // commits popped from the bottom of root undoStack_
+    CheckpointPolicy checkpointPolicy_;
+    std::deque<Checkpoint> checkpoints_;
+    size_t opsSinceCheckpoint_ = 0;
+    size_t bytesSinceCheckpoint_ = 0;
+    size_t maxVersions_ = 0; // 0 -> no versions are published
+    CommitId lastOperation_ = EmptyTransaction;
+    VersionPtr latest_; // writer side copy of published_
+    std::atomic<VersionPtr> published_;
+    mutable std::mutex versionsMutex_;
+    std::deque<VersionPtr> versions_; // newest at the back, for getAt
+    std::unique_ptr<Journal> journal_;
+    ByteWriter journalFrame_; // events of the running top-level operation
+    bool journalError_ = false;
+    RecordBuffer<ModifyRecord> *trace_ = nullptr; // 不为空时, 倒着执行产生的每条反向记录按顺序拷贝一份进来
+    [[no_unique_address]] LogPolicy logPolicy_;
+    [[no_unique_address]] StatsPolicy statsPolicy_;
 
   public:
+    // 参数原样转发给原子, 右值的新值直接移进去
+    // 原子一次修改可以产生几条记录(返回std::vector<ModifyRecord>), 按顺序记下
+    // 值没有变(记录全是Fail, 或者没有记录)时返回false, Fail记录照样留着
     template <typename... Args>
-    void modify(ModifyType modifyType, Args... args)
+    bool modify(ModifyType modifyType, Args &&...args)
     {
         assert(inTransaction());
-        auto modifyRecord = BaseType::modify(modifyType, std::forward<Args>(args)...);
-        curCommit_->modifyRecords_.emplace_back(std::move(modifyRecord));
+        auto result = BaseType::modify(modifyType, std::forward<Args>(args)...);
+        if constexpr (std::is_same_v<decltype(result), std::vector<ModifyRecord>>)
+        {
+            bool applied = false;
+            for (auto &rec : result)
+            {
+                applied |= !failed(rec);
+                addRecord(std::move(rec));
+            }
+            return applied;
+        }
+        else
+        {
+            bool applied = !failed(result);
+            addRecord(std::move(result));
+            return applied;
+        }
     }
 
-    const ValueType &get() const
+    // 写线程自己用, 包含还没结束的事务里的修改
+    // 一般是const ValueType &, 组合的原子返回成员引用的tuple
+    decltype(auto) get() const
     {
         return BaseType::getRaw();
     }
 
+    // 开始在每个顶层操作结束时发布只读版本, 保留最近maxVersions个给getAt
+    // 和其他修改一样只能在写线程, 事务外调用
+    void enableSnapshots(size_t maxVersions = 1)
+    {
+        static_assert(Snapshots, "the atom cannot make snapshots of its value, e.g. move-only elements");
+        assert(!inTransaction() && maxVersions > 0);
+        maxVersions_ = maxVersions;
+        {
+            std::lock_guard<std::mutex> lock(versionsMutex_);
+            while (versions_.size() > maxVersions_)
+                versions_.pop_front();
+        }
+        if (!latest_)
+            publishVersion();
+    }
+
+    void disableSnapshots()
+    {
+        maxVersions_ = 0;
+        latest_.reset();
+        published_.store(nullptr, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(versionsMutex_);
+        versions_.clear();
+    }
+
+    // 最近一个结束的顶层操作之后的值, 看不到正在进行的事务, 任何线程都可以调用
+    // 拿到的版本一直有效, 没有enableSnapshots时返回nullptr
+    VersionPtr snapshot() const
+    {
+        return published_.load(std::memory_order_acquire);
+    }
+
+    // 顶层操作id刚结束时的版本, 已经不在保留的版本里时返回nullptr
+    VersionPtr getAt(CommitId id) const
+    {
+        std::lock_guard<std::mutex> lock(versionsMutex_);
+        for (auto riter = versions_.rbegin(); riter != versions_.rend(); ++riter)
+        {
+            if ((*riter)->id_ == id)
+                return *riter;
+        }
+        return nullptr;
+    }
+
     bool inTransaction()
     {
-        return bool(curCommit_);
+        return curCommit_ != nullptr;
     }
 
-    void beginTransaction()
+    void enableLog()
     {
-        std::shared_ptr<Commit> newCommit(new Commit());
-        newCommit->tag_ = CommitTag::beginTrans;
-        newCommit->id_ = nextCommitId_++;
-        newCommit->parent_ = curCommit_;
-        LOG << currentLayerLogPrefix(newCommit) << "begin transaction, CommitId=" << newCommit->id_ << std::endl;
+        logPolicy_.enable();
+    }
 
-        if (!curCommit_)
+    void disableLog()
+    {
+        logPolicy_.disable();
+    }
+
+    LogPolicy &logPolicy()
+    {
+        return logPolicy_;
+    }
+
+    // 计数和延迟直方图, 可以在别的线程读
+    const StatsPolicy &stats() const
+    {
+        return statsPolicy_;
+    }
+
+    StatsPolicy &stats()
+    {
+        return statsPolicy_;
+    }
+
+    HistoryStats historyStats() const
+    {
+        HistoryStats stats;
+        std::vector<const Layer *> layers{&root_};
+        for (const Commit *commit = curCommit_; commit; commit = commit->parent_)
+            layers.insert(layers.begin() + 1, &commit->children_);
+        for (const Layer *layer : layers)
         {
-            if (!root_)
-                root_ = std::make_shared<Commits>();
-            root_->emplace_back(newCommit);
-            curCommit_ = newCommit;
-            return;
+            stats.undoDepths_.emplace_back(layer->undoStack_.size());
+            stats.redoDepths_.emplace_back(layer->redoStack_.size());
+        }
+        stats.historyBytes_ = retainedBytes_;
+        stats.liveCommits_ = pool_.size();
+        stats.pooledCommits_ = pool_.capacity();
+        return stats;
+    }
+
+    // 打开journal, 先把文件里已有的历史重放出来, 之后每个结束的顶层操作追加一帧
+    // 必须在第一个事务之前调用, 构造参数和各种policy要和写journal时一样
+    // 有snapshot时从snapshot的值开始只重放之后的帧, snapshot之前的历史不能再undo
+    // 文件打不开或者内容和重放结果对不上时返回false
+    bool openJournal(const std::string &path, const JournalOptions &options = {})
+    {
+        static_assert(Journaled, "the atom cannot encode its records or value");
+        assert(!inTransaction() && !journal_);
+        auto journal = std::make_unique<Journal>();
+        if (!journal->open(path, options))
+            return false;
+
+        auto replayFrames = [this](ByteReader &reader) { return replayFrame(reader); };
+        bool replayed = false;
+        std::string state;
+        uint64_t from = 0;
+        if (options.snapshots_ && root_.commits_.empty() && nextCommitId_ == 0 && journal->readSnapshot(state, from))
+        {
+            ValueType initial = get();
+            ByteReader reader(state.data(), state.size());
+            CommitId nextId = reader.getVarint();
+            if (reader.ok() && BaseType::decodeSelf(reader))
+            {
+                nextCommitId_ = nextId;
+                replayed = journal->replay(replayFrames, from);
+            }
+            // snapshot之后的帧还引用snapshot之前的commit, 从头重放
+            if (!replayed)
+                resetHistory(initial);
+        }
+        if (!replayed && !journal->replay(replayFrames))
+            return false;
+
+        journal_ = std::move(journal);
+        journalFrame_.clear();
+        journalError_ = false;
+        return true;
+    }
+
+    void closeJournal()
+    {
+        journal_.reset();
+        journalFrame_.clear();
+    }
+
+    // 有帧没写进journal文件, 异步journal的写线程失败也算
+    bool journalError() const
+    {
+        return journalError_ || (journal_ && journal_->failed());
+    }
+
+    // 到目前为止结束的顶层操作都fsync之后调用callback(ok), 没有journal时直接callback(false)
+    // JournalOptions::async_时endTransaction不等磁盘, callback在journal的写线程上调用
+    void whenDurable(std::function<void(bool)> callback)
+    {
+        if (journal_)
+            journal_->whenDurable(std::move(callback));
+        else
+            callback(false);
+    }
+
+    std::future<bool> durable()
+    {
+        auto promise = std::make_shared<std::promise<bool>>();
+        auto future = promise->get_future();
+        whenDurable([promise](bool ok) { promise->set_value(ok); });
+        return future;
+    }
+
+    void setCoalescePolicy(CoalescePolicy policy)
+    {
+        coalescePolicy_ = policy;
+    }
+
+    CoalescePolicy coalescePolicy() const
+    {
+        return coalescePolicy_;
+    }
+
+    void setRetentionPolicy(const RetentionPolicy &policy)
+    {
+        retentionPolicy_ = policy;
+        applyRetentionPolicy();
+    }
+
+    const RetentionPolicy &retentionPolicy() const
+    {
+        return retentionPolicy_;
+    }
+
+    void setCompactPolicy(const CompactPolicy &policy)
+    {
+        static_assert(Packable, "the atom does not implement packRecords/unpackRecords");
+        compactPolicy_ = policy;
+        packCold();
+    }
+
+    const CompactPolicy &compactPolicy() const
+    {
+        return compactPolicy_;
+    }
+
+    void setCheckpointPolicy(const CheckpointPolicy &policy)
+    {
+        checkpointPolicy_ = policy;
+        while (checkpoints_.size() > checkpointPolicy_.maxCheckpoints_)
+            checkpoints_.pop_front();
+    }
+
+    const CheckpointPolicy &checkpointPolicy() const
+    {
+        return checkpointPolicy_;
+    }
+
+    const std::deque<Checkpoint> &checkpoints() const
+    {
+        return checkpoints_;
+    }
+
+    // 给当前值拍一个checkpoint, 打开了journal时同时写snapshot
+    // 只能在事务外调用, snapshot写失败时journalError()变成true
+    void checkpoint()
+    {
+        assert(!inTransaction());
+        opsSinceCheckpoint_ = 0;
+        bytesSinceCheckpoint_ = 0;
+
+        checkpoints_.erase(std::remove_if(checkpoints_.begin(), checkpoints_.end(),
+                                          [this](const Checkpoint &cp) { return checkpointDead(cp); }),
+                           checkpoints_.end());
+        // 值不能拷贝的原子(元素只能移动)没有checkpoint, 也不会打开journal
+        if constexpr (Restorable)
+        {
+            if (!root_.undoStack_.empty() && checkpointPolicy_.maxCheckpoints_ > 0)
+            {
+                CommitId id = root_.undoStack_.back()->id_;
+                size_t depth = rootEvicted_ + root_.undoStack_.size();
+                if (checkpoints_.empty() || checkpoints_.back().id_ != id || checkpoints_.back().depth_ != depth)
+                {
+                    if (checkpoints_.size() == checkpointPolicy_.maxCheckpoints_)
+                        checkpoints_.pop_front();
+                    checkpoints_.push_back(Checkpoint{id, depth, get()});
+                }
+            }
         }
 
-        if (!curCommit_->children_)
+        if constexpr (Journaled)
+        {
+            if (journal_ && journal_->options().snapshots_)
+            {
+                ByteWriter state;
+                state.putVarint(nextCommitId_);
+                BaseType::encodeSelf(state);
+                // snapshot指向的帧必须先落盘
+                if (!journal_->sync() || !journal_->writeSnapshot(state.data()))
+                    journalError_ = true;
+            }
+        }
+    }
+
+    // 回到root层undoStack_里的commit id刚结束时的状态, 之后的undo/redo历史全部丢弃
+    // 从不早于id的最近一个checkpoint开始, 只倒着执行checkpoint和id之间的commit
+    // id不在root层undoStack_里时返回false
+    bool resetTo(CommitId id)
+    {
+        assert(!inTransaction());
+        CommitStack &undoStack = root_.undoStack_;
+        size_t target = undoStack.size();
+        while (target > 0 && undoStack[target - 1]->id_ != id)
+            --target;
+        if (!target)
+            return false;
+        LOG << "reset to CommitId=" << id << std::endl;
+
+        size_t from = undoStack.size();
+        const Checkpoint *nearest = nullptr;
+        for (const Checkpoint &cp : checkpoints_)
+        {
+            if (!checkpointValid(cp))
+                continue;
+            size_t depth = cp.depth_ - rootEvicted_;
+            if (depth >= target && depth < from)
+            {
+                from = depth;
+                nearest = &cp;
+            }
+        }
+        if (nearest)
+            BaseType::restore(nearest->value_);
+        for (size_t i = from; i-- > target;)
+            revert(undoStack[i]);
+
+        while (undoStack.size() > target)
+        {
+            release(undoStack.back());
+            undoStack.pop_back();
+        }
+        for (Commit *undoCommit : root_.redoStack_)
+        {
+            release(undoCommit);
+            release(undoCommit->target_);
+        }
+        root_.redoStack_.clear();
+        while (!checkpoints_.empty() && checkpoints_.back().depth_ > rootEvicted_ + target)
+            checkpoints_.pop_back();
+
+        if (journal_)
+        {
+            journalFrame_.putByte(static_cast<uint8_t>(Journal::Event::reset));
+            journalFrame_.putVarint(id);
+        }
+        compactHistory();
+        flushJournal();
+        lastOperation_ = id;
+        publishVersion();
+        return true;
+    }
+
+    // 回到root层undoStack_里的commit id刚结束时的值, 和resetTo不同, 历史不丢弃:
+    // 中间所有commit的反向记录合并成一个新的顶层commit提交, undo它就回到checkout之前
+    // 返回新commit的id, id不在root层undoStack_里或者已经是栈顶时返回EmptyTransaction
+    CommitId checkout(CommitId id)
+    {
+        static_assert(std::is_copy_constructible_v<ModifyRecord>, "checkout copies the records it rolls back");
+        assert(!inTransaction());
+        CommitStack &undoStack = root_.undoStack_;
+        size_t target = undoStack.size();
+        while (target > 0 && undoStack[target - 1]->id_ != id)
+            --target;
+        if (!target || target == undoStack.size())
+            return EmptyTransaction;
+        LOG << "checkout CommitId=" << id << std::endl;
+
+        uint64_t timer = statsPolicy_.startTimer();
+        Commit *commit = newCommitNode(CommitTag::endTrans, nullptr);
+        commit->id_ = nextCommitId_++;
+        for (size_t i = undoStack.size(); i-- > target;)
+            rollbackInto(undoStack[i], commit->modifyRecords_);
+        BaseType::coalesceModifyRecords(commit->modifyRecords_);
+
+        root_.commits_.emplace_back(commit);
+        undoStack.emplace_back(commit);
+        retain(commit);
+        for (Commit *undoCommit : root_.redoStack_)
+        {
+            release(undoCommit);
+            release(undoCommit->target_);
+        }
+        root_.redoStack_.clear();
+        if (journal_)
+        {
+            journalFrame_.putByte(static_cast<uint8_t>(Journal::Event::checkout));
+            journalFrame_.putVarint(commit->id_);
+            journalFrame_.putVarint(id);
+        }
+        finishOperation(commit, commit->id_);
+        statsPolicy_.onEndTransaction(timer);
+        return commit->id_;
+    }
+
+    // approximate memory held by undoable/redoable top-level history
+    size_t historyBytes() const
+    {
+        return retainedBytes_;
+    }
+
+    // 顶层还能undo几步, retention从栈底挤掉的不算
+    size_t undoDepth() const
+    {
+        return root_.undoStack_.size();
+    }
+
+    // 顶层还能redo几步, 新的提交会清空, retention也可能从栈底挤掉
+    size_t redoDepth() const
+    {
+        return root_.redoStack_.size();
+    }
+
+    void beginTransaction()
+    {
+        Commit *newCommit = newCommitNode(CommitTag::beginTrans, curCommit_);
+        newCommit->id_ = nextCommitId_++;
+        LOG << currentLayerLogPrefix(newCommit) << "begin transaction, CommitId=" << newCommit->id_ << std::endl;
+        if (journal_)
         {
-            curCommit_->children_ = std::make_shared<Commits>();
+            newCommit->journalMark_ = journalFrame_.size();
+            journalFrame_.putByte(static_cast<uint8_t>(Journal::Event::begin));
+            journalFrame_.putVarint(newCommit->id_);
+            journalFrame_.putVarint(journalId(curCommit_));
         }
 
-        curCommit_->children_->emplace_back(newCommit);
+        layerOf(curCommit_).commits_.emplace_back(newCommit);
         curCommit_ = newCommit;
+        if constexpr (Scoped)
+            BaseType::onBeginTransaction();
     }
 
     size_t endTransaction()
@@ -119,230 +721,799 @@ class TransInterface : private AtomInterface<Tp>
         if (!inTransaction())
             return EmptyTransaction;
 
-        std::vector<ModifyRecord> &modifyRecords = curCommit_->modifyRecords_;
+        uint64_t timer = statsPolicy_.startTimer();
+        if (coalescePolicy_ == CoalescePolicy::recordsAndChildren)
+            foldChildren(curCommit_);
+        if (coalescePolicy_ != CoalescePolicy::none)
+            coalesceRecords(curCommit_);
+
+        RecordBuffer<ModifyRecord> &modifyRecords = curCommit_->modifyRecords_;
         CommitId id = curCommit_->id_;
         curCommit_->tag_ = CommitTag::endTrans;
         LOG << currentLayerLogPrefix(curCommit_) << "end transaction, CommitId=" << id
             << " modifyRecord:" << BaseType::serialModifyRecords(modifyRecords) << std::endl;
-        curCommit_ = curCommit_->parent_.lock();
+
+        Commit *parent = curCommit_->parent_;
+        Layer &layer = layerOf(parent);
+        layer.undoStack_.emplace_back(curCommit_);
+        if (!parent)
+        {
+            retain(curCommit_);
+            for (Commit *undoCommit : layer.redoStack_)
+            {
+                release(undoCommit);
+                release(undoCommit->target_);
+            }
+        }
+        layer.redoStack_.clear();
+        curCommit_ = parent;
+        if constexpr (Scoped)
+            BaseType::onEndTransaction();
+        if (journal_)
+        {
+            journalFrame_.putByte(static_cast<uint8_t>(Journal::Event::end));
+            journalFrame_.putVarint(id);
+        }
+        if (!parent)
+            finishOperation(layer.undoStack_.back(), id);
+        statsPolicy_.onEndTransaction(timer);
         return id;
     }
 
-    void undo()
+    // 放弃当前事务: 整棵子树的修改(包括事务里的undo/redo)按时间倒着跑一遍, 子树还给pool_, 不留任何历史
+    // commit id和journal里这个事务写下的事件一起收回, 之后看起来就像从没begin过
+    bool abortTransaction()
     {
-        if (curCommit_)
-        {
-            if (curCommit_->children_->empty())
-                return;
+        if (!inTransaction())
+            return false;
 
-            undo(findUndoCommit(curCommit_->children_));
-            return;
-        }
+        uint64_t timer = statsPolicy_.startTimer();
+        Commit *commit = curCommit_;
+        LOG << currentLayerLogPrefix(commit) << "abort transaction, CommitId=" << commit->id_ << std::endl;
+        discard(commit, [this](ModifyRecord &rec) { BaseType::rollback(rec); });
 
-        if (!root_->empty())
+        Commit *parent = commit->parent_;
+        Layer &layer = layerOf(parent);
+        assert(layer.commits_.back() == commit);
+        layer.commits_.pop_back();
+        // 事务开着的时候新的commit都在它下面, 它的id之后分出去的id都属于这棵子树
+        nextCommitId_ = commit->id_;
+        if (journal_)
+            journalFrame_.truncate(commit->journalMark_);
+        destroy(commit);
+        curCommit_ = parent;
+        if constexpr (Scoped)
+            BaseType::onEndTransaction();
+        statsPolicy_.onAbort(timer);
+        return true;
+    }
+
+    // 当前层没有可以undo的commit时返回false
+    bool undo()
+    {
+        Layer &layer = layerOf(curCommit_);
+        LOG << currentLayerLogPrefix(layer.commits_) << "undo:: " << serialCommits(layer.commits_) << std::endl;
+        if (layer.undoStack_.empty())
+            return false;
+
+        uint64_t timer = statsPolicy_.startTimer();
+        Commit *commit = layer.undoStack_.back();
+        layer.undoStack_.pop_back();
+        Commit *undoCommit = undo(commit, curCommit_);
+        if (journal_)
+            journalOperation(Journal::Event::undo, undoCommit, commit);
+        if (!curCommit_)
         {
-            undo(findUndoCommit(root_));
+            rebill(commit);
+            retain(undoCommit);
+            finishOperation(undoCommit, undoCommit->id_);
         }
+        statsPolicy_.onUndo(timer);
+        return true;
     }
 
-    void redo()
+    // 当前层没有可以redo的commit时返回false
+    bool redo()
     {
-        if (curCommit_)
-        {
-            if (curCommit_->children_->empty())
-                return;
+        Layer &layer = layerOf(curCommit_);
+        LOG << currentLayerLogPrefix(layer.commits_) << "redo:: " << serialCommits(layer.commits_) << std::endl;
+        if (layer.redoStack_.empty())
+            return false;
 
-            redo(findRedoCommit(curCommit_->children_));
-            return;
+        uint64_t timer = statsPolicy_.startTimer();
+        Commit *commit = layer.redoStack_.back();
+        layer.redoStack_.pop_back();
+        Commit *redoCommit = redo(commit, curCommit_);
+        if (journal_)
+            journalOperation(Journal::Event::redo, redoCommit, commit);
+        if (!curCommit_)
+        {
+            release(commit);
+            rebill(commit->target_);
+            finishOperation(commit->target_, redoCommit->id_);
         }
+        statsPolicy_.onRedo(timer);
+        return true;
+    }
 
-        if (!root_->empty())
+  private:
+    static constexpr bool Packable = requires(ByteWriter &writer, ByteReader &reader,
+                                              RecordBuffer<ModifyRecord> &records) {
+        BaseType::packRecords(writer, records);
+        BaseType::unpackRecords(reader, records);
+    };
+    // 元素只能移动的原子不能拷贝值, 没有snapshot/checkpoint, 也没有编码
+    static constexpr bool Journaled = requires(BaseType &atom, ByteWriter &writer, ByteReader &reader,
+                                               const ModifyRecord &rec) {
+        atom.encodeRecord(writer, rec);
+        atom.replayRecord(reader);
+        atom.encodeSelf(writer);
+        atom.decodeSelf(reader);
+    };
+    static constexpr bool Snapshots = requires(BaseType &atom) { atom.makeSnapshot(nullptr); };
+    static constexpr bool Restorable = requires(BaseType &atom, const ValueType &val) { atom.restore(val); };
+    // 原子要知道自己在哪个事务里(比如每个事务每页只存一次原内容)
+    static constexpr bool Scoped = requires(BaseType &atom) {
+        atom.onBeginTransaction();
+        atom.onEndTransaction();
+    };
+
+    // 有Fail类型的原子, Fail记录表示这次修改没有生效
+    static bool failed(const ModifyRecord &rec)
+    {
+        if constexpr (requires { rec.type_ == ModifyType::Fail; })
+            return rec.type_ == ModifyType::Fail;
+        else
+            return false;
+    }
+
+    void addRecord(ModifyRecord &&rec)
+    {
+        curCommit_->modifyRecords_.emplace_back(std::move(rec));
+        statsPolicy_.onRecord();
+        if constexpr (Journaled)
         {
-            redo(findRedoCommit(root_));
+            if (journal_)
+            {
+                journalFrame_.putByte(static_cast<uint8_t>(Journal::Event::record));
+                BaseType::encodeRecord(journalFrame_, curCommit_->modifyRecords_.back());
+            }
         }
     }
 
-  private:
-    void undo(std::shared_ptr<Commit> commit)
+    bool logEnabled() const
     {
-        if (!commit)
-            return;
+        return LogPolicy::compiled && logPolicy_.enabled();
+    }
 
-        assert(commit->tag_ == CommitTag::endTrans);
-        LOG << currentLayerLogPrefix(commit) << "undo transaction, CommitId=" << commit->id_ << std::endl;
+    // journal里的commit引用, 0 -> root
+    static CommitId journalId(const Commit *commit)
+    {
+        return commit ? commit->id_ + 1 : 0;
+    }
+
+    void journalOperation(Journal::Event event, const Commit *newCommit, const Commit *target)
+    {
+        journalFrame_.putByte(static_cast<uint8_t>(event));
+        journalFrame_.putVarint(newCommit->id_);
+        journalFrame_.putVarint(target->id_);
+        journalFrame_.putVarint(journalId(newCommit->parent_));
+    }
+
+    // 顶层操作结束: 裁剪历史, 写journal, 发布只读版本, 到了checkpoint policy的间隔就拍checkpoint
+    // commit是这次操作加进历史的retained commit, id是这次操作自己的commit
+    void finishOperation(const Commit *commit, CommitId id)
+    {
+        opsSinceCheckpoint_++;
+        bytesSinceCheckpoint_ += commit->bytes_;
+        lastOperation_ = id;
+        applyRetentionPolicy();
+        packCold();
+        flushJournal();
+        publishVersion();
+        if (opsSinceCheckpoint_ >= checkpointPolicy_.everyCommits_ ||
+            bytesSinceCheckpoint_ >= checkpointPolicy_.everyBytes_)
+            checkpoint();
+    }
 
-        auto children = commit->children_;
-        if (children)
+    void flushJournal()
+    {
+        if (!journal_ || journalFrame_.empty())
+            return;
+        if (!journal_->append(journalFrame_.data()))
+            journalError_ = true;
+        journalFrame_.clear();
+    }
+
+    // 一帧是一个完整的顶层操作, 按原来的顺序重新执行一遍, id和栈顶要和记录的一致
+    bool replayFrame(ByteReader &reader)
+    {
+        while (!reader.empty())
         {
-            while (auto undoCommit = findUndoCommit(children))
+            Journal::Event event = static_cast<Journal::Event>(reader.getByte());
+            switch (event)
             {
-                undo(undoCommit);
+            case Journal::Event::begin: {
+                CommitId id = reader.getVarint();
+                CommitId parent = reader.getVarint();
+                if (id != nextCommitId_ || parent != journalId(curCommit_))
+                    return false;
+                beginTransaction();
+                break;
             }
+
+            case Journal::Event::record:
+                if (!inTransaction())
+                    return false;
+                curCommit_->modifyRecords_.emplace_back(BaseType::replayRecord(reader));
+                break;
+
+            case Journal::Event::end:
+                if (!inTransaction() || reader.getVarint() != curCommit_->id_)
+                    return false;
+                endTransaction();
+                break;
+
+            case Journal::Event::undo:
+            case Journal::Event::redo: {
+                CommitId id = reader.getVarint();
+                CommitId target = reader.getVarint();
+                CommitId parent = reader.getVarint();
+                Layer &layer = layerOf(curCommit_);
+                CommitStack &stack = event == Journal::Event::undo ? layer.undoStack_ : layer.redoStack_;
+                if (parent != journalId(curCommit_) || stack.empty() || stack.back()->id_ != target)
+                    return false;
+                if (event == Journal::Event::undo)
+                    undo();
+                else
+                    redo();
+                if (nextCommitId_ != id + 1)
+                    return false;
+                break;
+            }
+
+            case Journal::Event::reset:
+                if (inTransaction() || !resetTo(reader.getVarint()))
+                    return false;
+                break;
+
+            case Journal::Event::checkout: {
+                CommitId id = reader.getVarint();
+                CommitId target = reader.getVarint();
+                if (inTransaction() || id != nextCommitId_ || checkout(target) != id)
+                    return false;
+                break;
+            }
+
+            default:
+                return false;
+            }
+            if (!reader.ok())
+                return false;
         }
-        std::shared_ptr<Commit> newCommit(new Commit());
-        newCommit->tag_ = CommitTag::undo;
-        newCommit->id_ = nextCommitId_++;
-        newCommit->parent_ = commit->parent_;
-        // 把commit的modifyRecord倒着跑一遍
-        LOG << currentLayerLogPrefix(commit) << "undo modifyRecord:" << BaseType::serialModifyRecords(commit->modifyRecords_)
-            << std::endl;
-        for (auto riter = commit->modifyRecords_.rbegin(); riter != commit->modifyRecords_.rend(); ++riter)
-        {
-            std::string oldStr = BaseType::serialSelf();
-            auto &oldRecord = *riter;
-            auto newRecord = BaseType::rollback(oldRecord);
-            newCommit->modifyRecords_.emplace_back(std::move(newRecord));
-            LOG << currentLayerLogPrefix(commit) << "undo modifyRecord, oldVal=" << oldStr
-                << ", newVal=" << BaseType::serialSelf() << std::endl;
+        return !inTransaction();
+    }
+
+    // 丢掉全部历史, 值回到value, 和刚构造完一样
+    void resetHistory(const ValueType &value)
+    {
+        if constexpr (Scoped)
+        {
+            for (; curCommit_; curCommit_ = curCommit_->parent_)
+                BaseType::onEndTransaction();
+        }
+        for (Commit *commit : root_.commits_)
+            destroy(commit);
+        root_.clear();
+        curCommit_ = nullptr;
+        nextCommitId_ = 0;
+        retainedBytes_ = 0;
+        retainedCount_ = 0;
+        rootEvicted_ = 0;
+        checkpoints_.clear();
+        opsSinceCheckpoint_ = 0;
+        bytesSinceCheckpoint_ = 0;
+        BaseType::restore(value);
+        lastOperation_ = EmptyTransaction;
+        {
+            std::lock_guard<std::mutex> lock(versionsMutex_);
+            versions_.clear();
         }
+        publishVersion();
+    }
 
-        auto parent = commit->parent_.lock();
-        if (parent)
+    void publishVersion()
+    {
+        if constexpr (Snapshots)
         {
-            parent->children_->emplace_back(newCommit);
+            if (!maxVersions_)
+                return;
+            auto version = std::make_shared<const Version>(
+                Version{lastOperation_, BaseType::makeSnapshot(latest_ ? &latest_->value_ : nullptr)});
+            published_.store(version, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(versionsMutex_);
+                versions_.emplace_back(version);
+                if (versions_.size() > maxVersions_)
+                    versions_.pop_front();
+            }
+            latest_ = std::move(version);
+        }
+    }
+
+    bool checkpointValid(const Checkpoint &cp) const
+    {
+        if (cp.depth_ <= rootEvicted_ || cp.depth_ - rootEvicted_ > root_.undoStack_.size())
+            return false;
+        return root_.undoStack_[cp.depth_ - rootEvicted_ - 1]->id_ == cp.id_;
+    }
+
+    // 已经无效并且redo也不会让它重新有效
+    bool checkpointDead(const Checkpoint &cp) const
+    {
+        size_t depth = cp.depth_ - std::min(cp.depth_, rootEvicted_);
+        if (!depth || depth > root_.undoStack_.size() + root_.redoStack_.size())
+            return true;
+        return depth <= root_.undoStack_.size() && !checkpointValid(cp);
+    }
+
+    // children layer of commit, nullptr stands for root
+    Layer &layerOf(Commit *commit)
+    {
+        return commit ? commit->children_ : root_;
+    }
+
+    Commit *newCommitNode(CommitTag tag, Commit *parent)
+    {
+        Commit *commit = pool_.acquire();
+        commit->tag_ = tag;
+        commit->parent_ = parent;
+        commit->mark_ = parent ? parent->modifyRecords_.size() : 0;
+        return commit;
+    }
+
+    // 整棵子树还给pool_
+    void destroy(Commit *commit)
+    {
+        for (Commit *child : commit->children_.commits_)
+            destroy(child);
+        pool_.release(commit);
+    }
+
+    // 子事务的修改按时间顺序穿插进commit自己的记录里, 子树整个还给pool_
+    // 有事务里的undo/redo时同一批值先后在几条记录里, 只能倒着撤销时拷贝一份, 再撤销这些拷贝重放出执行顺序的记录;
+    // 记录不能拷贝时子事务原样留着
+    void foldChildren(Commit *commit)
+    {
+        if (commit->children_.commits_.empty())
+            return;
+
+        RecordBuffer<ModifyRecord> records;
+        if (linear(commit))
+        {
+            flattenRecords(commit, records);
+        }
+        else if constexpr (std::is_copy_constructible_v<ModifyRecord>)
+        {
+            RecordBuffer<ModifyRecord> undone;
+            traceRewind(commit, undone);
+            for (auto riter = undone.rbegin(); riter != undone.rend(); ++riter)
+                records.emplace_back(BaseType::rollback(*riter));
         }
         else
         {
-            root_->emplace_back(newCommit);
+            return;
         }
+        commit->modifyRecords_.swap(records);
+        for (Commit *child : commit->children_.commits_)
+            destroy(child);
+        commit->children_.clear();
     }
 
-    void redo(std::shared_ptr<Commit> commit)
+    // 原子按记录全部执行完之后的值合并, 只有最后一个子commit之后的那段记录满足这个条件;
+    // 前面的记录夹着子事务, 原样留着, 子commit的mark_也就不用改
+    void coalesceRecords(Commit *commit)
     {
-        if (!commit)
+        RecordBuffer<ModifyRecord> &records = commit->modifyRecords_;
+        const Commits &children = commit->children_.commits_;
+        size_t tail = children.empty() ? 0 : children.back()->mark_;
+        if (!tail)
+        {
+            BaseType::coalesceModifyRecords(records);
             return;
+        }
+        RecordBuffer<ModifyRecord> rest;
+        for (size_t i = tail; i < records.size(); ++i)
+            rest.emplace_back(std::move(records[i]));
+        records.erase(records.begin() + tail, records.end());
+        BaseType::coalesceModifyRecords(rest);
+        for (auto &rec : rest)
+            records.emplace_back(std::move(rec));
+    }
+
+    // 子树里只有提交, 没有事务里的undo/redo
+    static bool linear(const Commit *commit)
+    {
+        for (const Commit *child : commit->children_.commits_)
+        {
+            if (child->tag_ != CommitTag::endTrans || !linear(child))
+                return false;
+        }
+        return true;
+    }
+
+    // linear的子树, 子事务的记录按mark_穿插进commit自己的记录就是执行顺序
+    void flattenRecords(Commit *commit, RecordBuffer<ModifyRecord> &out)
+    {
+        RecordBuffer<ModifyRecord> &records = commit->modifyRecords_;
+        size_t next = 0;
+        for (Commit *child : commit->children_.commits_)
+        {
+            assert(child->mark_ <= records.size());
+            for (; next < child->mark_; ++next)
+                out.emplace_back(std::move(records[next]));
+            flattenRecords(child, out);
+        }
+        for (; next < records.size(); ++next)
+            out.emplace_back(std::move(records[next]));
+    }
+
+    // 撤销commit, 新的undo commit挂在parent这一层并压入该层的redoStack_
+    // commit的记录变成反向记录移给undo commit, 子commit的撤销挂在undo commit下面, redo时再还回来
+    Commit *undo(Commit *commit, Commit *parent)
+    {
+        assert(commit->tag_ == CommitTag::endTrans);
+        LOG << currentLayerLogPrefix(commit) << "undo transaction, CommitId=" << commit->id_ << std::endl;
+
+        Commit *newCommit = newCommitNode(CommitTag::undo, parent);
+        newCommit->target_ = commit;
+        rollbackRecords(commit, newCommit, "undo");
+        newCommit->id_ = nextCommitId_++;
 
+        Layer &layer = layerOf(parent);
+        layer.commits_.emplace_back(newCommit);
+        layer.redoStack_.emplace_back(newCommit);
+        return newCommit;
+    }
+
+    // 重做undo commit, 新的redo commit挂在parent这一层, 被撤销的原commit回到该层的undoStack_
+    // undo commit整个再倒着跑一遍就是原来的执行顺序, 记录和子事务的mark_都和原commit一一对应
+    Commit *redo(Commit *commit, Commit *parent)
+    {
         assert(commit->tag_ == CommitTag::undo);
         LOG << currentLayerLogPrefix(commit) << "redo transaction, CommitId=" << commit->id_ << std::endl;
 
-        auto children = commit->children_;
-        if (children)
+        Commit *newCommit = newCommitNode(CommitTag::redo, parent);
+        newCommit->target_ = commit;
+        rollbackRecords(commit, newCommit, "redo");
+        // 重做出来的就是原commit的记录, 还给它, 以后undo它时再用
+        unpack(commit->target_);
+        commit->target_->modifyRecords_.swap(newCommit->modifyRecords_);
+        newCommit->id_ = nextCommitId_++;
+
+        Layer &layer = layerOf(parent);
+        layer.commits_.emplace_back(newCommit);
+        layer.undoStack_.emplace_back(commit->target_);
+        return newCommit;
+    }
+
+    // 和undo的执行顺序一样, 但是不留历史
+    void revert(Commit *commit)
+    {
+        discard(commit, [this](ModifyRecord &rec) { BaseType::rollback(rec); });
+    }
+
+    // 和revert一样撤销commit, 反向记录按执行顺序追加到out; commit还留在历史里, 撤销的是整棵子树的拷贝
+    void rollbackInto(Commit *commit, RecordBuffer<ModifyRecord> &out)
+    {
+        Commit *copy = copyTree(commit);
+        traceRewind(copy, out);
+        destroy(copy);
+    }
+
+    // commit这一层按时间倒着撤销: 自己的记录倒着交给onRecord, 倒到子commit的mark_时撤销它那一次修改,
+    // 产生的undo/redo commit挂在parent下面
+    // 提交、事务里的undo、redo各是一次修改; 同一个子事务反复undo/redo时值只有一份, 在最后一次那里
+    // (undo -> 那个undo commit, 提交/redo -> 原commit), 每倒着撤销一次就交还给前一次
+    template <typename RecordFn>
+    void rewind(Commit *commit, Commit *parent, RecordFn &&onRecord)
+    {
+        unpack(commit);
+        RecordBuffer<ModifyRecord> &records = commit->modifyRecords_;
+        const Commits &children = commit->children_.commits_;
+        std::vector<std::pair<Commit *, Commit *>> holders; // 原commit -> 现在拿着它的值的commit
+        size_t end = records.size();
+        for (size_t i = children.size(); i-- > 0;)
         {
-            while (auto redoCommit = findRedoCommit(children))
+            Commit *child = children[i];
+            assert(child->mark_ <= end);
+            for (; end > child->mark_; --end)
+                onRecord(records[end - 1]);
+
+            Commit *origin = originOf(child);
+            auto iter = std::find_if(holders.begin(), holders.end(), [&](auto &pair) { return pair.first == origin; });
+            if (iter == holders.end())
+                iter = holders.emplace(holders.end(), origin, child->tag_ == CommitTag::undo ? child : origin);
+            Commit *&holder = iter->second;
+            assert((holder->tag_ == CommitTag::undo) == (child->tag_ == CommitTag::undo));
+            if (child->tag_ == CommitTag::undo)
+            {
+                redo(holder, parent);
+                holder = origin;
+                continue;
+            }
+            holder = undo(holder, parent);
+            // 倒回这次redo之前, 值回到被它重做的undo commit里, 接着倒回那次undo时用
+            if (child->tag_ == CommitTag::redo)
             {
-                redo(redoCommit);
+                moveRecords(holder, child->target_);
+                holder = child->target_;
             }
         }
+        for (; end > 0; --end)
+            onRecord(records[end - 1]);
+    }
 
-        std::shared_ptr<Commit> newCommit(new Commit());
-        newCommit->tag_ = CommitTag::redo;
-        newCommit->id_ = nextCommitId_++;
-        newCommit->parent_ = commit->parent_;
-        // 把commit的modifyRecord倒着跑一遍
-        LOG << currentLayerLogPrefix(commit) << "undo modifyRecord:" << BaseType::serialModifyRecords(commit->modifyRecords_)
-            << std::endl;
-        for (auto riter = commit->modifyRecords_.rbegin(); riter != commit->modifyRecords_.rend(); ++riter)
-        {
-            std::string oldStr = BaseType::serialSelf();
-            auto &oldRecord = *riter;
-            auto newRecord = BaseType::rollback(oldRecord);
-            newCommit->modifyRecords_.emplace_back(std::move(newRecord));
-            LOG << currentLayerLogPrefix(commit) << "undo modifyRecord, oldVal=" << oldStr
-                << ", newVal=" << BaseType::serialSelf() << std::endl;
+    // undo/redo commit最终都来自一个提交
+    static Commit *originOf(Commit *commit)
+    {
+        switch (commit->tag_)
+        {
+        case CommitTag::undo:
+            return commit->target_;
+        case CommitTag::redo:
+            return commit->target_->target_;
+        default:
+            return commit;
         }
+    }
+
+    // from和to是同一个提交的两次undo, 子树一一对应; from整棵子树的记录搬到to
+    void moveRecords(Commit *from, Commit *to)
+    {
+        unpack(to);
+        assert(to->modifyRecords_.empty());
+        to->modifyRecords_.swap(from->modifyRecords_);
+        const Commits &fromChildren = from->children_.commits_;
+        const Commits &toChildren = to->children_.commits_;
+        assert(fromChildren.size() == toChildren.size());
+        for (size_t i = 0; i < fromChildren.size(); ++i)
+            moveRecords(fromChildren[i], toChildren[i]);
+    }
+
+    // 把commit倒着跑一遍, 反向记录存进newCommit, commit的记录清空
+    void rollbackRecords(Commit *commit, Commit *newCommit, const char *action)
+    {
+        unpack(commit);
+        LOG << currentLayerLogPrefix(commit) << action
+            << " modifyRecord:" << BaseType::serialModifyRecords(commit->modifyRecords_) << std::endl;
+        rewind(commit, newCommit, [&](ModifyRecord &rec) {
+            std::string oldStr;
+            if (logEnabled())
+                oldStr = BaseType::serialSelf();
+            newCommit->modifyRecords_.emplace_back(BaseType::rollback(rec));
+            if constexpr (std::is_copy_constructible_v<ModifyRecord>)
+            {
+                if (trace_)
+                    trace_->emplace_back(newCommit->modifyRecords_.back());
+            }
+            LOG << currentLayerLogPrefix(commit) << action << " modifyRecord, oldVal=" << oldStr
+                << ", newVal=" << BaseType::serialSelf() << std::endl;
+        });
+        commit->modifyRecords_.clear();
+    }
 
-        auto parent = commit->parent_.lock();
-        if (parent)
+    // 撤销commit, 不留历史; 子commit撤销产生的undo/redo commit挂在临时节点下面, 用完连同id一起收回
+    template <typename RecordFn>
+    void discard(Commit *commit, RecordFn &&onRecord)
+    {
+        if (commit->children_.commits_.empty())
         {
-            parent->children_->emplace_back(newCommit);
+            rewind(commit, nullptr, onRecord);
+            return;
         }
-        else
+        CommitId nextId = nextCommitId_;
+        Commit *scratch = newCommitNode(CommitTag::undo, nullptr);
+        rewind(commit, scratch, onRecord);
+        destroy(scratch);
+        nextCommitId_ = nextId;
+    }
+
+    // discard, 所有反向记录(包括子commit的)按产生的顺序拷贝进out, 倒着撤销out就回到discard之前
+    void traceRewind(Commit *commit, RecordBuffer<ModifyRecord> &out)
+    {
+        RecordBuffer<ModifyRecord> *prev = std::exchange(trace_, &out);
+        discard(commit, [&](ModifyRecord &rec) { out.emplace_back(BaseType::rollback(rec)); });
+        trace_ = prev;
+    }
+
+    // commit整棵子树的拷贝, 子树里的target_指向对应的拷贝
+    Commit *copyTree(const Commit *commit)
+    {
+        std::vector<std::pair<const Commit *, Commit *>> copies;
+        Commit *copy = copyNodes(commit, nullptr, copies);
+        for (auto &&entry : copies)
         {
-            root_->emplace_back(newCommit);
+            Commit *node = entry.second;
+            auto iter = std::find_if(copies.begin(), copies.end(),
+                                     [&](auto &pair) { return node->target_ && pair.first == node->target_; });
+            if (iter != copies.end())
+                node->target_ = iter->second;
         }
+        return copy;
     }
 
-    // not-finished-commit -> nullptr
-    // commit -> commit
-    // commit undo -> nullptr
-    // commit undo redo -> commit
-    // commit undo undo redo -> nullptr
-    std::shared_ptr<Commit> findUndoCommit(std::shared_ptr<Commits> commits)
+    Commit *copyNodes(const Commit *commit, Commit *parent, std::vector<std::pair<const Commit *, Commit *>> &copies)
     {
-        if (!commits)
-            return nullptr;
+        Commit *copy = pool_.acquire();
+        copy->tag_ = commit->tag_;
+        copy->id_ = commit->id_;
+        copy->modifyRecords_ = commit->modifyRecords_;
+        copy->parent_ = parent;
+        copy->target_ = commit->target_;
+        copy->mark_ = commit->mark_;
+        copy->packed_ = commit->packed_;
+        copy->packedRecords_ = commit->packedRecords_;
+        copies.emplace_back(commit, copy);
+        for (const Commit *child : commit->children_.commits_)
+            copy->children_.commits_.emplace_back(copyNodes(child, copy, copies));
+        return copy;
+    }
+
+    size_t commitBytes(const Commit &commit) const
+    {
+        size_t bytes = sizeof(Commit) + commit.packedRecords_.capacity();
+        for (auto &&rec : commit.modifyRecords_)
+            bytes += BaseType::recordBytes(rec);
+        // 内联的记录本身已经算在sizeof(Commit)里
+        if (!commit.modifyRecords_.heapBytes())
+            bytes -= commit.modifyRecords_.size() * sizeof(ModifyRecord);
+
+        const Layer &children = commit.children_;
+        bytes += (children.commits_.size() + children.undoStack_.size() + children.redoStack_.size()) * sizeof(Commit *);
+        for (Commit *child : children.commits_)
+            bytes += commitBytes(*child);
+        return bytes;
+    }
 
-        LOG << currentLayerLogPrefix(commits) << "findUndoCommit:: " << serialCommits(commits) << std::endl;
-        size_t undoCnt = 0;
-        for (auto iter = commits->rbegin(); iter != commits->rend(); ++iter)
+    // retain/release只针对root层, 被undo/redo栈引用的commit才算在历史里
+    void retain(Commit *commit)
+    {
+        if (commit->retained_)
+            return;
+        commit->bytes_ = commitBytes(*commit);
+        commit->retained_ = true;
+        retainedBytes_ += commit->bytes_;
+        retainedCount_++;
+    }
+
+    void release(Commit *commit)
+    {
+        if (!commit->retained_)
+            return;
+        commit->retained_ = false;
+        retainedBytes_ -= commit->bytes_;
+        retainedCount_--;
+    }
+
+    // 子树记录变了之后重新计算retained commit占的内存
+    void rebill(Commit *commit)
+    {
+        if (!commit->retained_)
+            return;
+        retainedBytes_ -= commit->bytes_;
+        commit->bytes_ = commitBytes(*commit);
+        retainedBytes_ += commit->bytes_;
+    }
+
+    // 栈只在栈顶变化, 已经打包的commit下面都已经打包过, 从冷热分界往下走到第一个打包过的就停
+    void packCold()
+    {
+        if constexpr (Packable)
         {
-            if (!*iter)
-                continue;
-            CommitTag tag = (*iter)->tag_;
-            switch (tag)
+            for (const CommitStack *stack : {&root_.undoStack_, &root_.redoStack_})
             {
-            case CommitTag::beginTrans:
-                return nullptr;
-            case CommitTag::endTrans: {
-                if (!undoCnt)
-                    return *iter;
-                undoCnt--;
-                break;
-            }
-            case CommitTag::undo:
-                undoCnt++;
-                break;
-            case CommitTag::redo:
-                undoCnt--;
-                break;
-            default:
-                assert(false);
+                if (stack->size() <= compactPolicy_.hotDepth_)
+                    continue;
+                for (size_t i = stack->size() - compactPolicy_.hotDepth_; i-- > 0;)
+                {
+                    Commit *commit = (*stack)[i];
+                    if (commit->packed_)
+                        break;
+                    pack(commit);
+                    rebill(commit);
+                }
             }
         }
-        return nullptr;
     }
 
-    // not-finished-commit -> nullptr
-    // empty -> nullptr
-    // commit commit -> nullptr
-    // undo commit -> nullptr
-    // commit undo -> undo
-    // commit undo1 undo2 -> undo2
-    // commit undo redo -> undo
-    // commit commit commit undo1 undo2 undo3 redo3 redo2 -> undo1
-    std::shared_ptr<Commit> findRedoCommit(std::shared_ptr<Commits> commits)
+    void pack(Commit *commit)
     {
-        if (!commits)
-            return nullptr;
-
-        LOG << currentLayerLogPrefix(commits) << "findRedoCommit:: " << serialCommits(commits) << std::endl;
+        if constexpr (Packable)
+        {
+            for (Commit *child : commit->children_.commits_)
+                pack(child);
+            if (commit->packed_)
+                return;
+            ByteWriter writer;
+            BaseType::packRecords(writer, commit->modifyRecords_);
+            commit->packedRecords_ = writer.data();
+            commit->packedRecords_.shrink_to_fit();
+            commit->modifyRecords_.clear();
+            commit->modifyRecords_.shrink_to_fit();
+            commit->packed_ = true;
+        }
+    }
 
-        size_t redoCnt = 0;
-        for (auto iter = commits->rbegin(); iter != commits->rend(); ++iter)
+    // 子commit用到时各自解码
+    void unpack(Commit *commit)
+    {
+        if constexpr (Packable)
         {
-            if (!*iter)
-                continue;
+            if (!commit->packed_)
+                return;
+            ByteReader reader(commit->packedRecords_.data(), commit->packedRecords_.size());
+            bool ok = BaseType::unpackRecords(reader, commit->modifyRecords_);
+            assert(ok && reader.empty());
+            (void)ok;
+            std::string().swap(commit->packedRecords_);
+            commit->packed_ = false;
+        }
+    }
 
-            switch ((*iter)->tag_)
+    void applyRetentionPolicy()
+    {
+        if (retentionPolicy_.unlimited())
+            return;
+
+        auto overBudget = [&]() {
+            return root_.undoStack_.size() > retentionPolicy_.maxUndoDepth_ ||
+                   retainedBytes_ > retentionPolicy_.maxHistoryBytes_;
+        };
+        while (overBudget())
+        {
+            if (!root_.undoStack_.empty())
             {
-            case CommitTag::beginTrans:
-            case CommitTag::endTrans:
-                return nullptr;
-            case CommitTag::undo: {
-                if (!redoCnt)
-                    return *iter;
-                redoCnt--;
-                break;
+                // 最老的commit变成永久状态
+                release(root_.undoStack_.front());
+                root_.undoStack_.pop_front();
+                rootEvicted_++;
             }
-            case CommitTag::redo: {
-                redoCnt++;
-                break;
+            else if (!root_.redoStack_.empty())
+            {
+                release(root_.redoStack_.front()->target_);
+                release(root_.redoStack_.front());
+                root_.redoStack_.pop_front();
             }
-            default:
-                assert(false);
+            else
+            {
+                break;
             }
         }
-
-        return nullptr;
+        compactHistory();
     }
 
-    std::string serialCommits(std::shared_ptr<Commits> commits)
+    void compactHistory()
     {
-        if (!commits)
-            return "";
+        // 只在垃圾和有效历史一样多时才整理, 均摊O(1)
+        // 垃圾之间可能通过target_互相引用, 但一次整理会全部回收, 有效commit不会指向垃圾
+        if (root_.commits_.size() > 2 * retainedCount_ + 16)
+        {
+            auto garbage = [this](Commit *commit) {
+                if (commit->retained_ || commit->tag_ == CommitTag::beginTrans)
+                    return false;
+                destroy(commit);
+                return true;
+            };
+            root_.commits_.erase(std::remove_if(root_.commits_.begin(), root_.commits_.end(), garbage),
+                                 root_.commits_.end());
+        }
+    }
 
+    std::string serialCommits(const Commits &commits)
+    {
         std::ostringstream oss;
-        for (auto &&commit : *commits)
+        for (Commit *commit : commits)
         {
             switch (commit->tag_)
             {
@@ -366,24 +1537,24 @@ class TransInterface : private AtomInterface<Tp>
         return oss.str();
     }
 
-    std::string currentLayerLogPrefix(std::shared_ptr<Commit> commit)
+    std::string currentLayerLogPrefix(const Commit *commit)
     {
         size_t currentLayerIndex = 0;
-        while (commit->parent_.lock())
+        while (commit->parent_)
         {
             currentLayerIndex++;
-            commit = commit->parent_.lock();
+            commit = commit->parent_;
         }
         if (!currentLayerIndex)
             return "";
         return std::string(currentLayerIndex, '-') + std::string(" ");
     }
 
-    std::string currentLayerLogPrefix(std::shared_ptr<Commits> commits)
+    std::string currentLayerLogPrefix(const Commits &commits)
     {
-        if (!commits || (commits && commits->empty()))
+        if (commits.empty())
             return "[Empty Commits, cannot locate layer]";
 
-        return currentLayerLogPrefix(commits->front());
+        return currentLayerLogPrefix(commits.front());
     }
 };
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include "atomicTuple.h"
+#include "transInterface.h"
+
+// 几个不同类型的原子共用一棵commit树和一份历史
+// 一次beginTransaction/endTransaction/undo/redo同时覆盖所有成员, retention/journal/snapshot也是同一份
+// 成员在类型参数里注册: TransactionManager<int, std::vector<int>> mgr(0, std::vector<int>(4, 0));
+template <typename... Ts>
+class TransactionManager : public TransInterface<std::tuple<Ts...>>
+{
+  public:
+    typedef TransInterface<std::tuple<Ts...>> BaseType;
+    typedef AtomInterface<std::tuple<Ts...>> AtomType;
+
+    template <size_t I>
+    using ModifyTypeOf = typename AtomType::template Member<I>::ModifyType;
+
+  public:
+    TransactionManager(Ts... vals) : BaseType(std::move(vals)...)
+    {
+    }
+
+    using BaseType::get;
+    using BaseType::modify;
+
+    // 修改第I个成员, 参数和单独的TransInterface<T>::modify一样
+    template <size_t I, typename... Args>
+    void modify(ModifyTypeOf<I> type, Args &&...args)
+    {
+        static_assert(requires(typename AtomType::template Member<I> &atom, Args &&...a) {
+            atom.modify(type, std::forward<Args>(a)...);
+        }, "modify arguments do not match the atom");
+        BaseType::modify(AtomType::template on<I>(type), std::forward<Args>(args)...);
+    }
+
+    template <size_t I>
+    const std::tuple_element_t<I, std::tuple<Ts...>> &get() const
+    {
+        return std::get<I>(BaseType::get());
+    }
+};
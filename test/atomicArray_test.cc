@@ -0,0 +1,200 @@
+#include "atom.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+typedef AtomIntArray<8> AtomArray8;
+
+static_assert(std::is_same_v<SlotIndex<256>, uint8_t>);
+static_assert(std::is_same_v<SlotIndex<257>, uint16_t>);
+static_assert(std::is_same_v<SlotIndex<(1ull << 32) + 1>, uint64_t>);
+static_assert(sizeof(AtomIntArray<200>::ModifyRecord) == 8);
+
+TEST(AtomIntArray, ModifyUndoRedo)
+{
+    AtomArray8 as(std::array<int, 8>{0, 1, 2, 3, 4, 5, 6, 7});
+    as.setCoalescePolicy(AtomArray8::CoalescePolicy::records);
+    as.beginTransaction();
+    as.modify(AtomArray8::ModifyType::Modify, 5, 50);
+    as.modify(AtomArray8::ModifyType::Modify, 1, 10);
+    as.modify(AtomArray8::ModifyType::Modify, 5, 51);
+    as.modify(AtomArray8::ModifyType::Modify, 8, 80);
+    as.modify(AtomArray8::ModifyType::Modify, 3, 30);
+    as.modify(AtomArray8::ModifyType::Modify, 3, 3);
+    as.modify(AtomArray8::ModifyType::Modify, 5, 52);
+    as.endTransaction();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{0, 10, 2, 3, 4, 52, 6, 7}));
+
+    // 每个槽只留原值, 改回原值的槽和越界的Fail都去掉, 按槽排序
+    auto &records = as.root_.undoStack_.back()->modifyRecords_;
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[0].offset_, 1);
+    EXPECT_EQ(records[0].oldVal_, 1);
+    EXPECT_EQ(records[1].offset_, 5);
+    EXPECT_EQ(records[1].oldVal_, 5);
+
+    as.undo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{0, 1, 2, 3, 4, 5, 6, 7}));
+    as.redo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{0, 10, 2, 3, 4, 52, 6, 7}));
+}
+
+// 默认不合并, 但每个槽在一个事务里只存一次原值
+TEST(AtomIntArray, SavesEachSlotOncePerTransaction)
+{
+    AtomArray8 as;
+    as.beginTransaction();
+    for (int i = 1; i <= 3; ++i)
+        as.modify(AtomArray8::ModifyType::Modify, 2, i);
+    {
+        as.beginTransaction();
+        as.modify(AtomArray8::ModifyType::Modify, 2, 4);
+        as.modify(AtomArray8::ModifyType::Modify, 2, 5);
+        as.endTransaction();
+    }
+    // 子事务改过, 外层要再存一次
+    as.modify(AtomArray8::ModifyType::Modify, 2, 6);
+    as.modify(AtomArray8::ModifyType::Modify, 2, 7);
+    as.endTransaction();
+
+    AtomArray8::Commit *commit = as.root_.undoStack_.back();
+    std::vector<bool> saved;
+    for (auto &&rec : commit->modifyRecords_)
+        saved.push_back(rec.saved_);
+    EXPECT_EQ(saved, (std::vector<bool>{true, false, false, true, false}));
+    EXPECT_EQ(commit->modifyRecords_[3].oldVal_, 5);
+    ASSERT_EQ(commit->children_.undoStack_.back()->modifyRecords_.size(), 2);
+    EXPECT_TRUE(commit->children_.undoStack_.back()->modifyRecords_[0].saved_);
+
+    as.undo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{}));
+    as.redo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{0, 0, 7}));
+}
+
+TEST(AtomIntArray, NestedTransactions)
+{
+    AtomArray8 as;
+    as.beginTransaction();
+    {
+        as.modify(AtomArray8::ModifyType::Modify, 0, 1);
+        as.modify(AtomArray8::ModifyType::Modify, 2, 1);
+        as.beginTransaction();
+        as.modify(AtomArray8::ModifyType::Modify, 0, 2);
+        as.modify(AtomArray8::ModifyType::Modify, 0, 3);
+        as.modify(AtomArray8::ModifyType::Modify, 1, 3);
+        as.endTransaction();
+        EXPECT_EQ(as.get(), (std::array<int, 8>{3, 3, 1}));
+        as.undo();
+        EXPECT_EQ(as.get(), (std::array<int, 8>{1, 0, 1}));
+        as.redo();
+        as.beginTransaction();
+        as.modify(AtomArray8::ModifyType::Modify, 7, 7);
+        EXPECT_TRUE(as.abortTransaction());
+    }
+    as.endTransaction();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{3, 3, 1}));
+    as.undo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{}));
+    as.redo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{3, 3, 1}));
+}
+
+TEST(AtomIntArray, RandomEditsWithCompaction)
+{
+    typedef AtomIntArray<1000> Atom;
+    Atom as;
+    as.setCompactPolicy({2});
+    std::vector<std::array<int, 1000>> history{as.get()};
+    std::mt19937 rng(7);
+    for (int i = 0; i < 200; ++i)
+    {
+        as.beginTransaction();
+        for (int n = 0; n < 50; ++n)
+            as.modify(Atom::ModifyType::Modify, rng() % 1000, static_cast<int>(rng() % 5));
+        as.endTransaction();
+        history.push_back(as.get());
+    }
+    for (int round = 0; round < 2; ++round)
+    {
+        for (size_t i = history.size() - 1; i-- > 0;)
+        {
+            as.undo();
+            ASSERT_EQ(as.get(), history[i]);
+        }
+        for (size_t i = 1; i < history.size(); ++i)
+        {
+            as.redo();
+            ASSERT_EQ(as.get(), history[i]);
+        }
+    }
+}
+
+TEST(AtomIntArray, CheckoutAndSnapshot)
+{
+    AtomArray8 as;
+    as.enableSnapshots(4);
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 3; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomArray8::ModifyType::Modify, i, i);
+        as.modify(AtomArray8::ModifyType::Modify, 0, i);
+        ids.push_back(as.endTransaction());
+    }
+    EXPECT_EQ(as.snapshot()->value_, (std::array<int, 8>{3, 1, 2, 3}));
+    EXPECT_NE(as.checkout(ids[0]), AtomArray8::EmptyTransaction);
+    EXPECT_EQ(as.get(), (std::array<int, 8>{1, 1}));
+    EXPECT_EQ(as.getAt(ids[1])->value_, (std::array<int, 8>{2, 1, 2}));
+    as.undo();
+    EXPECT_EQ(as.get(), (std::array<int, 8>{3, 1, 2, 3}));
+}
+
+TEST(AtomArray, StringSlots)
+{
+    typedef TransInterface<std::array<std::string, 4>> Atom;
+    Atom as;
+    as.beginTransaction();
+    as.modify(Atom::ModifyType::Modify, 2, std::string(100, 'x'));
+    as.modify(Atom::ModifyType::Modify, 2, "y");
+    as.endTransaction();
+    EXPECT_EQ(as.get()[2], "y");
+    as.undo();
+    EXPECT_EQ(as.get()[2], "");
+    as.redo();
+    EXPECT_EQ(as.get()[2], "y");
+}
+
+// 合并之后子事务的mark_还要指在对的位置上
+TEST(AtomArray, CoalesceAroundChildren)
+{
+    typedef TransInterface<std::array<std::string, 4>> Atom;
+    Atom as(std::array<std::string, 4>{"a", "b"});
+    for (bool abort : {true, false})
+    {
+        as.beginTransaction();
+        {
+            as.beginTransaction();
+            for (int i = 0; i < 3; ++i)
+                as.modify(Atom::ModifyType::Modify, 0, std::to_string(i));
+            as.beginTransaction();
+            as.modify(Atom::ModifyType::Modify, 1, "x");
+            as.endTransaction();
+            as.modify(Atom::ModifyType::Modify, 2, "y");
+            as.modify(Atom::ModifyType::Modify, 2, "z");
+            as.endTransaction();
+        }
+        if (abort)
+        {
+            EXPECT_TRUE(as.abortTransaction());
+            EXPECT_EQ(as.get(), (std::array<std::string, 4>{"a", "b"}));
+            continue;
+        }
+        as.endTransaction();
+        EXPECT_EQ(as.get(), (std::array<std::string, 4>{"2", "x", "z"}));
+        as.undo();
+        EXPECT_EQ(as.get(), (std::array<std::string, 4>{"a", "b"}));
+        as.redo();
+        EXPECT_EQ(as.get(), (std::array<std::string, 4>{"2", "x", "z"}));
+    }
+}
@@ -0,0 +1,170 @@
+#include "atom.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef AtomByteBuffer::ModifyType ModifyType;
+static constexpr size_t PageSize = AtomInterface<ByteBuffer>::PageSize;
+
+static std::vector<std::byte> bytesOf(const ByteBuffer &buf)
+{
+    return std::vector<std::byte>(buf.data(), buf.data() + buf.size());
+}
+
+TEST(AtomByteBuffer, SavesEachPageOncePerTransaction)
+{
+    AtomByteBuffer as(ByteBuffer{4 * PageSize});
+    as.beginTransaction();
+    for (int i = 0; i < 100; ++i)
+        as.modify(ModifyType::Write, PageSize + i * 8, static_cast<uint64_t>(i));
+    as.modify(ModifyType::Write, 3 * PageSize + 10, 7);
+    as.modify(ModifyType::Write, 4 * PageSize - 2, 7);
+    as.endTransaction();
+
+    // 两页各存一次, 越界的Fail和没存页的记录都合并掉了
+    auto &records = as.root_.undoStack_.back()->modifyRecords_;
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[0].pages_, std::vector<size_t>{1});
+    EXPECT_EQ(records[0].saved_.size(), PageSize);
+    EXPECT_EQ(records[1].pages_, std::vector<size_t>{3});
+
+    uint64_t val;
+    memcpy(&val, as.get().data() + PageSize + 99 * 8, sizeof(val));
+    EXPECT_EQ(val, 99);
+    as.undo();
+    EXPECT_EQ(bytesOf(as.get()), std::vector<std::byte>(4 * PageSize));
+    as.redo();
+    memcpy(&val, as.get().data() + PageSize + 99 * 8, sizeof(val));
+    EXPECT_EQ(val, 99);
+}
+
+TEST(AtomByteBuffer, WriteAcrossPagesAndShortLastPage)
+{
+    const size_t size = 2 * PageSize + 100;
+    AtomByteBuffer as(ByteBuffer{size});
+    std::string text(PageSize + 200, 'x');
+    as.beginTransaction();
+    as.modify(ModifyType::Write, size - text.size(), text.data(), text.size());
+    as.endTransaction();
+
+    auto &records = as.root_.undoStack_.back()->modifyRecords_;
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records[0].pages_, (std::vector<size_t>{0, 1, 2}));
+    EXPECT_EQ(records[0].saved_.size(), size);
+    EXPECT_EQ(static_cast<char>(as.get().data()[size - 1]), 'x');
+
+    as.undo();
+    EXPECT_EQ(bytesOf(as.get()), std::vector<std::byte>(size));
+    as.redo();
+    EXPECT_EQ(static_cast<char>(as.get().data()[size - text.size()]), 'x');
+    EXPECT_EQ(static_cast<char>(as.get().data()[size - text.size() - 1]), '\0');
+}
+
+TEST(AtomByteBuffer, NestedAndAbort)
+{
+    AtomByteBuffer as(ByteBuffer{2 * PageSize});
+    as.beginTransaction();
+    {
+        as.modify(ModifyType::Write, 0, 1);
+        // 子事务里同一页要重新存一次, 子事务单独undo时用
+        as.beginTransaction();
+        as.modify(ModifyType::Write, 0, 2);
+        as.modify(ModifyType::Write, 4, 2);
+        as.endTransaction();
+        EXPECT_EQ(as.root_.commits_.back()->children_.undoStack_.back()->modifyRecords_.size(), 1);
+        as.undo();
+        int val;
+        memcpy(&val, as.get().data(), sizeof(val));
+        EXPECT_EQ(val, 1);
+        as.redo();
+
+        as.beginTransaction();
+        as.modify(ModifyType::Write, PageSize, 3);
+        as.modify(ModifyType::Write, 0, 3);
+        EXPECT_TRUE(as.abortTransaction());
+        // abort之后回到外层事务, 第0页被子事务写过, 外层要再存一次
+        as.modify(ModifyType::Write, 8, 1);
+    }
+    as.endTransaction();
+    int vals[3];
+    memcpy(vals, as.get().data(), sizeof(vals));
+    EXPECT_EQ(vals[0], 2);
+    EXPECT_EQ(vals[1], 2);
+    EXPECT_EQ(vals[2], 1);
+    EXPECT_EQ(as.get().data()[PageSize], std::byte{0});
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_.size(), 2);
+
+    as.undo();
+    EXPECT_EQ(bytesOf(as.get()), std::vector<std::byte>(2 * PageSize));
+    as.redo();
+    memcpy(vals, as.get().data(), sizeof(vals));
+    EXPECT_EQ(vals[0], 2);
+    EXPECT_EQ(vals[2], 1);
+}
+
+TEST(AtomByteBuffer, RandomWritesUndoRedo)
+{
+    const size_t size = 16 * PageSize + 123;
+    AtomByteBuffer as(ByteBuffer{size});
+    std::vector<std::vector<std::byte>> history{bytesOf(as.get())};
+    std::mt19937 rng(11);
+    for (int i = 0; i < 50; ++i)
+    {
+        as.beginTransaction();
+        for (int n = 0; n < 20; ++n)
+        {
+            size_t len = rng() % (2 * PageSize);
+            size_t offset = rng() % (size - len + 1);
+            std::vector<std::byte> data(len, static_cast<std::byte>(rng()));
+            as.modify(ModifyType::Write, offset, data.data(), len);
+        }
+        as.endTransaction();
+        history.push_back(bytesOf(as.get()));
+    }
+    for (int round = 0; round < 2; ++round)
+    {
+        for (size_t i = history.size() - 1; i-- > 0;)
+        {
+            as.undo();
+            ASSERT_EQ(bytesOf(as.get()), history[i]);
+        }
+        for (size_t i = 1; i < history.size(); ++i)
+        {
+            as.redo();
+            ASSERT_EQ(bytesOf(as.get()), history[i]);
+        }
+    }
+}
+
+TEST(AtomByteBuffer, MappedFile)
+{
+    std::string path = testing::TempDir() + "atomicByteBuffer_test.map";
+    unlink(path.c_str());
+    ByteBuffer buf;
+    ASSERT_TRUE(buf.map(path, 3 * PageSize));
+    EXPECT_TRUE(buf.mapped());
+
+    AtomByteBuffer as(std::move(buf));
+    EXPECT_TRUE(as.get().mapped());
+    as.beginTransaction();
+    as.modify(ModifyType::Write, PageSize, 42);
+    as.endTransaction();
+    as.beginTransaction();
+    as.modify(ModifyType::Write, PageSize + 4, 43);
+    as.endTransaction();
+    as.undo();
+
+    // MAP_SHARED写进去的马上就能从同一个文件的另一个映射看到
+    ByteBuffer reopened;
+    ASSERT_TRUE(reopened.map(path, 3 * PageSize));
+    int vals[2];
+    memcpy(vals, reopened.data() + PageSize, sizeof(vals));
+    EXPECT_EQ(vals[0], 42);
+    EXPECT_EQ(vals[1], 0);
+    // 拷贝出来的是堆上的
+    ByteBuffer copy(reopened);
+    EXPECT_FALSE(copy.mapped());
+    EXPECT_EQ(copy, reopened);
+    unlink(path.c_str());
+}
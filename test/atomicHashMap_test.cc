@@ -0,0 +1,120 @@
+#include "atom.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_map>
+
+TEST(AtomIntMap, InsertAssignErase)
+{
+    AtomIntMap as(FlatHashMap<int, int>{{1, 10}, {2, 20}});
+    as.beginTransaction();
+    as.modify(AtomIntMap::ModifyType::Insert, 3, 30);
+    as.modify(AtomIntMap::ModifyType::Insert, 1, 11);
+    as.modify(AtomIntMap::ModifyType::Assign, 2, 21);
+    as.modify(AtomIntMap::ModifyType::Assign, 4, 40);
+    as.modify(AtomIntMap::ModifyType::Erase, 1);
+    as.modify(AtomIntMap::ModifyType::Erase, 5);
+    as.endTransaction();
+    EXPECT_EQ(as.get(), (std::unordered_map<int, int>{{2, 21}, {3, 30}}));
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_[1].type_, AtomIntMap::ModifyType::Fail);
+
+    as.undo();
+    EXPECT_EQ(as.get(), (std::unordered_map<int, int>{{1, 10}, {2, 20}}));
+    as.redo();
+    EXPECT_EQ(as.get(), (std::unordered_map<int, int>{{2, 21}, {3, 30}}));
+}
+
+TEST(AtomIntMap, RollbackEraseReusesSlot)
+{
+    std::unordered_map<int, int> init;
+    for (int i = 0; i < 1000; ++i)
+        init.emplace(i, i);
+    AtomIntMap as(init);
+    size_t capacity = as.get().capacity();
+    size_t generation = as.get().generation();
+
+    as.beginTransaction();
+    for (int i = 0; i < 1000; i += 2)
+        as.modify(AtomIntMap::ModifyType::Erase, i);
+    as.endTransaction();
+    for (int round = 0; round < 10; ++round)
+    {
+        as.undo();
+        as.redo();
+    }
+    as.undo();
+    EXPECT_EQ(as.get(), init);
+    EXPECT_EQ(as.get().capacity(), capacity);
+    EXPECT_EQ(as.get().generation(), generation);
+}
+
+TEST(AtomIntMap, RandomEditsMatchModel)
+{
+    for (auto policy : {AtomIntMap::CoalescePolicy::none, AtomIntMap::CoalescePolicy::recordsAndChildren})
+    {
+        AtomIntMap as;
+        as.setCoalescePolicy(policy);
+        std::vector<std::unordered_map<int, int>> history{{}};
+        std::mt19937 rng(11);
+        for (int i = 0; i < 300; ++i)
+        {
+            std::unordered_map<int, int> model = history.back();
+            as.beginTransaction();
+            for (int n = 0; n < 20; ++n)
+            {
+                if (n == 10)
+                    as.beginTransaction();
+                int key = rng() % 64;
+                switch (rng() % 3)
+                {
+                case 0:
+                    as.modify(AtomIntMap::ModifyType::Insert, key, i);
+                    model.emplace(key, i);
+                    break;
+                case 1:
+                    as.modify(AtomIntMap::ModifyType::Assign, key, -i);
+                    if (model.count(key))
+                        model[key] = -i;
+                    break;
+                default:
+                    as.modify(AtomIntMap::ModifyType::Erase, key);
+                    model.erase(key);
+                    break;
+                }
+            }
+            as.endTransaction();
+            as.endTransaction();
+            history.push_back(model);
+            ASSERT_EQ(as.get(), model);
+
+            if (rng() % 3 == 0)
+            {
+                as.undo();
+                history.pop_back();
+                ASSERT_EQ(as.get(), history.back());
+            }
+        }
+        while (history.size() > 1)
+        {
+            as.undo();
+            history.pop_back();
+            ASSERT_EQ(as.get(), history.back());
+        }
+    }
+}
+
+// std::hash<int>是恒等映射, 连续的key不能挤在同一段探测链上: 一路插入, 最长探测一直很短
+TEST(FlatHashMap, SequentialKeys)
+{
+    FlatHashMap<int, int> map;
+    for (int i = 0; i < 160000; ++i)
+    {
+        map.insert(i, i);
+        if (i % 4096 == 0)
+        {
+            EXPECT_LE(map.maxProbeLength(), 16u);
+        }
+    }
+    EXPECT_EQ(map.size(), 160000);
+    EXPECT_EQ(*map.find(4242), 4242);
+    EXPECT_LE(map.maxProbeLength(), 16u);
+}
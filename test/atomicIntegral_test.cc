@@ -1,5 +1,6 @@
 #include "atom.h"
 #include <gtest/gtest.h>
+#include <sstream>
 
 TEST(AtomIntegral, Init)
 {
@@ -65,3 +66,596 @@ TEST(AtomIntegral, RecursiveRollBack)
     as.undo();
     EXPECT_TRUE(as.get() == 0);
 }
+
+TEST(AtomIntegral, UndoRedoSequence)
+{
+    AtomInt as(0);
+    for (int i = 1; i <= 3; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        as.endTransaction();
+    }
+
+    as.undo();
+    as.undo();
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    as.redo();
+    as.redo();
+    EXPECT_TRUE(as.get() == 2);
+    as.undo();
+    EXPECT_TRUE(as.get() == 1);
+    as.redo();
+    as.redo();
+    EXPECT_TRUE(as.get() == 3);
+    as.redo();
+    EXPECT_TRUE(as.get() == 3);
+
+    as.undo();
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 4);
+    as.endTransaction();
+    as.redo();
+    EXPECT_TRUE(as.get() == 4);
+    as.undo();
+    EXPECT_TRUE(as.get() == 2);
+}
+
+TEST(AtomIntegral, RecursiveRedo)
+{
+    AtomInt as(0);
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 2);
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 3);
+        as.endTransaction();
+    }
+    as.endTransaction();
+
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    as.redo();
+    EXPECT_TRUE(as.get() == 3);
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+}
+
+// 子事务在外层的记录前面, undo/redo都要按时间顺序
+TEST(AtomIntegral, InterleavedRecursiveUndoRedo)
+{
+    AtomInt as(0);
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 1);
+        as.endTransaction();
+    }
+    as.modify(AtomInt::ModifyType::modify, 2);
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 3);
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    as.modify(AtomInt::ModifyType::modify, 4);
+    as.endTransaction();
+
+    for (int round = 0; round < 2; ++round)
+    {
+        as.undo();
+        EXPECT_TRUE(as.get() == 0);
+        as.redo();
+        EXPECT_TRUE(as.get() == 4);
+    }
+
+    // 最后一步是子事务
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 5);
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 6);
+        as.endTransaction();
+    }
+    as.endTransaction();
+    as.undo();
+    EXPECT_TRUE(as.get() == 4);
+    as.redo();
+    EXPECT_TRUE(as.get() == 6);
+    as.undo();
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    as.redo();
+    as.redo();
+    EXPECT_TRUE(as.get() == 6);
+}
+
+// 子事务在事务里被undo之后又改了外层, abort要回到begin之前
+TEST(AtomIntegral, AbortAfterUndoInterleaved)
+{
+    AtomInt as(0);
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 1);
+        as.endTransaction();
+    }
+    as.modify(AtomInt::ModifyType::modify, 2);
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    EXPECT_TRUE(as.abortTransaction());
+    EXPECT_TRUE(as.get() == 0);
+}
+
+// 同样的事务提交之后, 外面的undo/redo也要把事务里的undo算进去
+TEST(AtomIntegral, UndoRedoAfterUndoInterleaved)
+{
+    AtomInt as(0);
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 1);
+        as.endTransaction();
+    }
+    as.modify(AtomInt::ModifyType::modify, 2);
+    as.undo();
+    as.endTransaction();
+    EXPECT_TRUE(as.get() == 0);
+
+    for (int round = 0; round < 2; ++round)
+    {
+        as.undo();
+        EXPECT_TRUE(as.get() == 0);
+        as.redo();
+        EXPECT_TRUE(as.get() == 0);
+    }
+
+    // 事务里undo之后外层再改一次
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 3);
+        as.endTransaction();
+    }
+    as.modify(AtomInt::ModifyType::modify, 4);
+    as.undo();
+    as.modify(AtomInt::ModifyType::modify, 5);
+    as.endTransaction();
+
+    for (int round = 0; round < 2; ++round)
+    {
+        as.undo();
+        EXPECT_TRUE(as.get() == 0);
+        as.redo();
+        EXPECT_TRUE(as.get() == 5);
+    }
+}
+
+TEST(AtomIntegral, RetentionUndoDepth)
+{
+    AtomInt as(0);
+    AtomInt::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 3;
+    as.setRetentionPolicy(policy);
+    for (int i = 1; i <= 100; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    EXPECT_LE(as.root_.commits_.size(), 2 * 3 + 16);
+
+    for (int i = 0; i < 5; ++i)
+        as.undo();
+    EXPECT_TRUE(as.get() == 97);
+    as.redo();
+    EXPECT_TRUE(as.get() == 98);
+}
+
+TEST(AtomIntegral, RetentionHistoryBytes)
+{
+    AtomInt as(0);
+    AtomInt::RetentionPolicy policy;
+    policy.maxHistoryBytes_ = 4096;
+    as.setRetentionPolicy(policy);
+    for (int i = 1; i <= 10000; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        as.endTransaction();
+        EXPECT_LE(as.historyBytes(), policy.maxHistoryBytes_);
+    }
+    EXPECT_LT(as.root_.commits_.size(), 200);
+
+    as.undo();
+    EXPECT_TRUE(as.get() == 9999);
+}
+
+TEST(AtomIntegral, RetentionRecyclesCommits)
+{
+    AtomInt as(0);
+    AtomInt::RetentionPolicy policy;
+    policy.maxUndoDepth_ = 8;
+    as.setRetentionPolicy(policy);
+    for (int i = 1; i <= 1000; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        {
+            as.beginTransaction();
+            as.modify(AtomInt::ModifyType::modify, -i);
+            as.endTransaction();
+        }
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    EXPECT_TRUE(as.get() == -1000);
+    EXPECT_LT(as.pool_.capacity(), 200);
+}
+
+TEST(AtomIntegral, LogPerInstance)
+{
+    typedef TransInterface<int, StreamLog> LoggedAtomInt;
+    std::ostringstream oss;
+    LoggedAtomInt as(0);
+    as.logPolicy().setStream(oss);
+
+    as.beginTransaction();
+    as.modify(LoggedAtomInt::ModifyType::modify, 1);
+    as.endTransaction();
+    as.undo();
+    EXPECT_TRUE(oss.str().empty());
+
+    as.enableLog();
+    as.redo();
+    EXPECT_NE(oss.str().find("redo modifyRecord, oldVal=0, newVal=1"), std::string::npos);
+
+    LoggedAtomInt other(0);
+    other.logPolicy().setStream(oss);
+    size_t logged = oss.str().size();
+    other.beginTransaction();
+    other.endTransaction();
+    EXPECT_EQ(oss.str().size(), logged);
+    EXPECT_TRUE(as.get() == 1);
+}
+
+TEST(AtomIntegral, Stats)
+{
+    typedef TransInterface<int, NoLog, TransStats> StatsAtomInt;
+    StatsAtomInt as(0);
+    as.stats().setSampleRate(1);
+    as.beginTransaction();
+    as.modify(StatsAtomInt::ModifyType::modify, 1);
+    as.beginTransaction();
+    as.modify(StatsAtomInt::ModifyType::modify, 2);
+    as.endTransaction();
+    as.beginTransaction();
+    as.modify(StatsAtomInt::ModifyType::modify, 3);
+
+    auto history = as.historyStats();
+    EXPECT_EQ(history.undoDepths_, (std::vector<size_t>{0, 1, 0}));
+    EXPECT_EQ(history.redoDepths_, (std::vector<size_t>{0, 0, 0}));
+    as.endTransaction();
+    as.endTransaction();
+    as.undo();
+    as.undo();
+    as.redo();
+
+    const TransStats &stats = as.stats();
+    EXPECT_EQ(stats.commits_, 3);
+    EXPECT_EQ(stats.records_, 3);
+    EXPECT_EQ(stats.undos_, 1);
+    EXPECT_EQ(stats.redos_, 1);
+    EXPECT_EQ(stats.endTransaction_.count(), 3);
+    EXPECT_GE(stats.endTransaction_.percentile(1), stats.endTransaction_.percentile(0.5));
+    EXPECT_EQ(stats.endTransaction_.percentile(1), stats.endTransaction_.max());
+
+    history = as.historyStats();
+    EXPECT_EQ(history.undoDepths_, (std::vector<size_t>{1}));
+    EXPECT_EQ(history.historyBytes_, as.historyBytes());
+    EXPECT_GE(history.liveCommits_, 3);
+
+    as.beginTransaction();
+    as.modify(StatsAtomInt::ModifyType::modify, 4);
+    EXPECT_TRUE(as.abortTransaction());
+    EXPECT_EQ(stats.aborts_, 1);
+    EXPECT_EQ(stats.commits_, 3);
+    EXPECT_EQ(stats.abort_.count(), 1);
+
+    as.stats().reset();
+    EXPECT_EQ(stats.commits_, 0);
+    EXPECT_EQ(stats.undo_.count(), 0);
+    static_assert(sizeof(AtomInt) < sizeof(StatsAtomInt));
+}
+
+TEST(LatencyHistogram, Percentiles)
+{
+    LatencyHistogram histogram;
+    for (uint64_t i = 1; i <= 10000; ++i)
+        histogram.record(i);
+    EXPECT_EQ(histogram.count(), 10000);
+    EXPECT_EQ(histogram.max(), 10000);
+    EXPECT_DOUBLE_EQ(histogram.mean(), 5000.5);
+    for (double q : {0.01, 0.5, 0.9, 0.99})
+    {
+        double expected = q * 10000;
+        EXPECT_GE(histogram.percentile(q), expected);
+        EXPECT_LE(histogram.percentile(q), expected * (1 + 1.0 / LatencyHistogram::SubBuckets));
+    }
+    histogram.record(std::numeric_limits<uint64_t>::max());
+    EXPECT_EQ(histogram.percentile(1), std::numeric_limits<uint64_t>::max());
+}
+
+TEST(AtomIntegral, CompactColdHistory)
+{
+    AtomInt as(0);
+    as.setCompactPolicy({0});
+    for (int i = 1; i <= 100; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i * 1000);
+        as.modify(AtomInt::ModifyType::modify, std::numeric_limits<int>::min() + i);
+        as.endTransaction();
+    }
+    EXPECT_TRUE(as.root_.undoStack_.back()->packed_);
+    size_t packedBytes = as.historyBytes();
+
+    as.undo();
+    EXPECT_TRUE(as.get() == std::numeric_limits<int>::min() + 99);
+    as.redo();
+    for (int i = 100; i > 0; --i)
+    {
+        EXPECT_TRUE(as.get() == std::numeric_limits<int>::min() + i);
+        as.undo();
+    }
+    EXPECT_TRUE(as.get() == 0);
+    EXPECT_GT(as.historyBytes(), packedBytes);
+}
+
+TEST(AtomIntegral, Checkout)
+{
+    AtomInt as(0);
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 100; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        ids.push_back(as.endTransaction());
+    }
+    as.checkout(ids[4]);
+    EXPECT_TRUE(as.get() == 5);
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_.size(), 1);
+
+    as.undo();
+    EXPECT_TRUE(as.get() == 100);
+
+    // 净效果是回到原值时没有记录
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 5);
+    as.endTransaction();
+    as.checkout(ids[4]);
+    EXPECT_TRUE(as.get() == 5);
+    EXPECT_TRUE(as.root_.undoStack_.back()->modifyRecords_.empty());
+    as.undo();
+    as.undo();
+    EXPECT_TRUE(as.get() == 100);
+}
+
+TEST(AtomIntegral, CoalesceRecords)
+{
+    AtomInt as(0);
+    as.setCoalescePolicy(AtomInt::CoalescePolicy::records);
+    as.beginTransaction();
+    for (int i = 1; i <= 1000; ++i)
+        as.modify(AtomInt::ModifyType::modify, i);
+    as.endTransaction();
+    EXPECT_EQ(as.root_.commits_.back()->modifyRecords_.size(), 1);
+
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    as.redo();
+    EXPECT_TRUE(as.get() == 1000);
+}
+
+// 最后一个子事务之后的记录才合并, 前面的原样留着
+TEST(AtomIntegral, CoalesceAroundChildren)
+{
+    AtomInt as(0);
+    as.setCoalescePolicy(AtomInt::CoalescePolicy::records);
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 1);
+    as.modify(AtomInt::ModifyType::modify, 2);
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 3);
+        as.endTransaction();
+    }
+    for (int i = 4; i <= 10; ++i)
+        as.modify(AtomInt::ModifyType::modify, i);
+    as.endTransaction();
+    EXPECT_EQ(as.root_.commits_.back()->modifyRecords_.size(), 3);
+
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    as.redo();
+    EXPECT_TRUE(as.get() == 10);
+}
+
+TEST(AtomIntegral, FoldChildren)
+{
+    AtomInt as(0);
+    as.setCoalescePolicy(AtomInt::CoalescePolicy::recordsAndChildren);
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 1);
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 2);
+        as.endTransaction();
+        as.undo();
+        as.redo();
+    }
+    as.modify(AtomInt::ModifyType::modify, 3);
+    as.endTransaction();
+
+    AtomInt::Commit *commit = as.root_.commits_.back();
+    EXPECT_TRUE(commit->children_.commits_.empty());
+    EXPECT_EQ(commit->modifyRecords_.size(), 1);
+    EXPECT_EQ(commit->modifyRecords_.front().oldVal_, 0);
+    EXPECT_EQ(commit->modifyRecords_.front().newVal_, 3);
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+    as.redo();
+    EXPECT_TRUE(as.get() == 3);
+}
+
+TEST(AtomIntegral, CheckpointResetTo)
+{
+    AtomInt as(0);
+    AtomInt::CheckpointPolicy policy;
+    policy.everyCommits_ = 4;
+    policy.maxCheckpoints_ = 3;
+    as.setCheckpointPolicy(policy);
+
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 20; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        ids.push_back(as.endTransaction());
+    }
+    ASSERT_EQ(as.checkpoints().size(), 3);
+    EXPECT_EQ(as.checkpoints().back().id_, ids[19]);
+
+    EXPECT_TRUE(as.resetTo(ids[14]));
+    EXPECT_TRUE(as.get() == 15);
+    EXPECT_FALSE(as.resetTo(ids[17]));
+    as.undo();
+    EXPECT_TRUE(as.get() == 14);
+    as.redo();
+    as.redo();
+    EXPECT_TRUE(as.get() == 15);
+
+    EXPECT_TRUE(as.resetTo(ids[2]));
+    EXPECT_TRUE(as.get() == 3);
+    as.undo();
+    as.undo();
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+}
+
+TEST(AtomIntegral, CheckpointAfterRetention)
+{
+    AtomInt as(0);
+    AtomInt::RetentionPolicy retention;
+    retention.maxUndoDepth_ = 6;
+    as.setRetentionPolicy(retention);
+    AtomInt::CheckpointPolicy policy;
+    policy.everyCommits_ = 3;
+    as.setCheckpointPolicy(policy);
+
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 30; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, i);
+        ids.push_back(as.endTransaction());
+        if (i % 5 == 0)
+        {
+            as.undo();
+            as.redo();
+        }
+    }
+    EXPECT_FALSE(as.resetTo(ids[22]));
+    EXPECT_TRUE(as.resetTo(ids[24]));
+    EXPECT_TRUE(as.get() == 25);
+}
+
+TEST(AtomIntegral, SnapshotIgnoresOpenTransaction)
+{
+    AtomInt as(0);
+    EXPECT_FALSE(as.snapshot());
+    as.enableSnapshots(2);
+    EXPECT_TRUE(as.snapshot()->value_ == 0);
+    EXPECT_EQ(as.snapshot()->id_, AtomInt::EmptyTransaction);
+
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 1);
+    size_t first = as.endTransaction();
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 2);
+    as.beginTransaction();
+    as.modify(AtomInt::ModifyType::modify, 3);
+    as.endTransaction();
+    as.undo();
+    EXPECT_TRUE(as.snapshot()->value_ == 1);
+    size_t second = as.endTransaction();
+    EXPECT_TRUE(as.snapshot()->value_ == 2);
+
+    EXPECT_TRUE(as.getAt(first)->value_ == 1);
+    as.undo();
+    EXPECT_TRUE(as.snapshot()->value_ == 1);
+    EXPECT_FALSE(as.getAt(first));
+    EXPECT_TRUE(as.getAt(second)->value_ == 2);
+}
+
+TEST(RecordBuffer, InlineAndHeap)
+{
+    typedef RecordBuffer<AtomInt::ModifyRecord> Records;
+    static_assert(Records::InlineCapacity == 2);
+    static_assert(sizeof(Records) <= sizeof(std::vector<AtomInt::ModifyRecord>) + 8);
+    static_assert(RecordBuffer<std::string>::InlineCapacity == 0);
+    static_assert(sizeof(RecordBuffer<std::string>) < sizeof(std::vector<std::string>));
+
+    Records small, big;
+    small.emplace_back(1, 2);
+    small.emplace_back(2, 3);
+    EXPECT_EQ(small.heapBytes(), 0);
+    for (int i = 0; i < 5; ++i)
+        big.emplace_back(i, i + 1);
+    EXPECT_GT(big.heapBytes(), 0);
+    // 参数引用了自己的元素, 扩容时不能先把它搬走
+    big.emplace_back(big.front());
+    EXPECT_EQ(big.back().newVal_, 1);
+
+    small.swap(big);
+    EXPECT_EQ(small.size(), 6);
+    EXPECT_EQ(big.size(), 2);
+    EXPECT_EQ(big.back().newVal_, 3);
+    big.swap(small);
+    EXPECT_EQ(small.size(), 2);
+
+    Records copy(big);
+    Records moved(std::move(big));
+    EXPECT_TRUE(big.empty());
+    EXPECT_EQ(copy.size(), 6);
+    EXPECT_EQ(moved.size(), 6);
+    moved.erase(moved.begin() + 1, moved.end());
+    moved.shrink_to_fit();
+    EXPECT_EQ(moved.heapBytes(), 0);
+    EXPECT_EQ(moved.front().oldVal_, 0);
+    moved = std::move(copy);
+    EXPECT_EQ(moved.size(), 6);
+    EXPECT_EQ(moved.rbegin()->oldVal_, 0);
+
+    RecordBuffer<std::string> strings;
+    strings.emplace_back(100, 'x');
+    strings.emplace_back("y");
+    RecordBuffer<std::string> other;
+    other.swap(strings);
+    EXPECT_TRUE(strings.empty());
+    EXPECT_EQ(other.back(), "y");
+    other.clear();
+    other.shrink_to_fit();
+    EXPECT_EQ(other.heapBytes(), 0);
+
+    // 长度是32位的, 超出时和std::vector一样抛异常, 原来的内容不动
+    other.emplace_back("z");
+    EXPECT_THROW(other.reserve(RecordBuffer<std::string>::max_size() + 1), std::length_error);
+    EXPECT_EQ(other.size(), 1);
+    EXPECT_EQ(other.back(), "z");
+}
@@ -0,0 +1,189 @@
+#include "atom.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+TEST(PersistentVector, InsertEraseMatchModel)
+{
+    PersistentVector<int> vec;
+    std::vector<int> model;
+    std::mt19937 rng(3);
+    for (int i = 0; i < 20000; ++i)
+    {
+        size_t offset = model.empty() ? 0 : rng() % (model.size() + 1);
+        if (rng() % 3 || model.empty())
+        {
+            vec.insert(offset, i);
+            model.insert(model.begin() + offset, i);
+        }
+        else
+        {
+            offset = std::min(offset, model.size() - 1);
+            vec.erase(offset);
+            model.erase(model.begin() + offset);
+        }
+    }
+    ASSERT_TRUE(vec == model);
+    for (size_t i = 0; i < model.size(); i += 97)
+        EXPECT_EQ(vec[i], model[i]);
+
+    while (!model.empty())
+    {
+        size_t offset = rng() % model.size();
+        vec.erase(offset);
+        model.erase(model.begin() + offset);
+    }
+    EXPECT_TRUE(vec.empty());
+}
+
+TEST(PersistentVector, CopiesAreIndependent)
+{
+    PersistentVector<int> vec(std::vector<int>(100000, 0));
+    PersistentVector<int> copy = vec;
+    EXPECT_TRUE(copy.sharesRoot(vec));
+
+    vec.set(50000, 1);
+    vec.insert(0, 2);
+    vec.erase(99999);
+    EXPECT_FALSE(copy.sharesRoot(vec));
+    EXPECT_TRUE(copy == std::vector<int>(100000, 0));
+    EXPECT_EQ(vec[0], 2);
+    EXPECT_EQ(vec[50001], 1);
+    EXPECT_EQ(vec.size(), 100000u);
+}
+
+TEST(AtomIntPersistentVector, SameRecordsAsVector)
+{
+    AtomIntPersistentVector as(std::vector<int>{1, 2, 3});
+    as.beginTransaction();
+    as.modify(AtomIntPersistentVector::ModifyType::Insert, 0, 0);
+    as.modify(AtomIntPersistentVector::ModifyType::Modify, 3, 30);
+    as.modify(AtomIntPersistentVector::ModifyType::Erase, 1);
+    as.modify(AtomIntPersistentVector::ModifyType::Modify, 10, 1);
+    std::vector<int> values{7, 8, 9};
+    as.modify(AtomIntPersistentVector::ModifyType::InsertRange, 1, values.begin(), values.end());
+    as.modify(AtomIntPersistentVector::ModifyType::EraseRange, 0, EraseCount{2});
+    as.modify(AtomIntPersistentVector::ModifyType::AssignRange, 1, values.begin(), values.begin() + 2);
+    as.modify(AtomIntPersistentVector::ModifyType::Modify, 0);
+    as.endTransaction();
+    EXPECT_TRUE(as.get() == (std::vector<int>{8, 7, 8, 30}));
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_[3].type_, AtomIntPersistentVector::ModifyType::Fail);
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_.back().type_, AtomIntPersistentVector::ModifyType::Fail);
+
+    as.undo();
+    EXPECT_TRUE(as.get() == (std::vector<int>{1, 2, 3}));
+    as.redo();
+    EXPECT_TRUE(as.get() == (std::vector<int>{8, 7, 8, 30}));
+}
+
+TEST(AtomIntPersistentVector, RandomEditsMatchModel)
+{
+    for (auto policy : {AtomIntPersistentVector::CoalescePolicy::none,
+                        AtomIntPersistentVector::CoalescePolicy::recordsAndChildren})
+    {
+        AtomIntPersistentVector as(std::vector<int>(5000, 0));
+        as.setCoalescePolicy(policy);
+        std::vector<std::vector<int>> history{std::vector<int>(5000, 0)};
+        std::mt19937 rng(5);
+        for (int i = 0; i < 200; ++i)
+        {
+            std::vector<int> model = history.back();
+            as.beginTransaction();
+            for (int n = 0; n < 20; ++n)
+            {
+                size_t offset = rng() % (model.size() + 1);
+                switch (rng() % 4)
+                {
+                case 0:
+                    as.modify(AtomIntPersistentVector::ModifyType::Insert, offset, i);
+                    model.insert(model.begin() + offset, i);
+                    break;
+                case 1:
+                    as.modify(AtomIntPersistentVector::ModifyType::Modify, offset, -i);
+                    if (offset < model.size())
+                        model[offset] = -i;
+                    break;
+                case 2:
+                    as.modify(AtomIntPersistentVector::ModifyType::Erase, offset);
+                    if (offset < model.size())
+                        model.erase(model.begin() + offset);
+                    break;
+                default: {
+                    size_t count = std::min<size_t>(rng() % 50, model.size() - offset);
+                    as.modify(AtomIntPersistentVector::ModifyType::EraseRange, offset, EraseCount{count});
+                    model.erase(model.begin() + offset, model.begin() + offset + count);
+                    break;
+                }
+                }
+            }
+            as.endTransaction();
+            history.push_back(model);
+            ASSERT_TRUE(as.get() == model) << i;
+
+            if (rng() % 3 == 0)
+            {
+                as.undo();
+                history.pop_back();
+                ASSERT_TRUE(as.get() == history.back()) << i;
+            }
+        }
+        while (history.size() > 1)
+        {
+            as.undo();
+            history.pop_back();
+            ASSERT_TRUE(as.get() == history.back());
+        }
+    }
+}
+
+TEST(AtomIntPersistentVector, SnapshotIsUnchangedByLaterEdits)
+{
+    AtomIntPersistentVector as(std::vector<int>(100000, 0));
+    as.enableSnapshots(4);
+    auto first = as.snapshot();
+    ASSERT_TRUE(first);
+    EXPECT_TRUE(first->value_.sharesRoot(as.get()));
+
+    as.beginTransaction();
+    as.modify(AtomIntPersistentVector::ModifyType::Modify, 50000, 1);
+    as.modify(AtomIntPersistentVector::ModifyType::Insert, 0, 2);
+    size_t id = as.endTransaction();
+
+    auto second = as.snapshot();
+    EXPECT_EQ(second->id_, id);
+    EXPECT_TRUE(second->value_.sharesRoot(as.get()));
+    EXPECT_EQ(second->value_[50001], 1);
+    EXPECT_TRUE(first->value_ == std::vector<int>(100000, 0));
+
+    as.undo();
+    EXPECT_TRUE(as.get() == std::vector<int>(100000, 0));
+    EXPECT_EQ(second->value_[0], 2);
+}
+
+TEST(AtomIntPersistentVector, JournalReplay)
+{
+    std::string path = ::testing::TempDir() + "persistent_vector_journal";
+    std::remove(path.c_str());
+    std::remove((path + ".snap").c_str());
+    std::vector<int> expected;
+    {
+        AtomIntPersistentVector as;
+        ASSERT_TRUE(as.openJournal(path));
+        for (int i = 0; i < 50; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomIntPersistentVector::ModifyType::Insert, i / 2, i);
+            std::vector<int> values{i, i + 1};
+            as.modify(AtomIntPersistentVector::ModifyType::AssignRange, 0, values.begin(), values.end());
+            as.endTransaction();
+        }
+        as.undo();
+        expected = as.get().toVector();
+    }
+    AtomIntPersistentVector replayed;
+    ASSERT_TRUE(replayed.openJournal(path));
+    EXPECT_TRUE(replayed.get() == expected);
+    std::remove(path.c_str());
+    std::remove((path + ".snap").c_str());
+}
@@ -1,5 +1,8 @@
 #include "atom.h"
 #include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include <thread>
 
 template <typename... Args>
 bool equal(const std::vector<int> &vec, Args... args)
@@ -119,4 +122,826 @@ TEST(AtomIntVector, UndoRedoRecursively)
     as.undo();
     EXPECT_FALSE(as.inTransaction());
     EXPECT_TRUE(equal(as));
-}
\ No newline at end of file
+}
+
+TEST(AtomIntVector, RangeInsertEraseAssign)
+{
+    AtomIntVector as(2, 0);
+    std::vector<int> block{1, 2, 3};
+    as.beginTransaction();
+    {
+        as.modify(AtomIntVector::ModifyType::InsertRange, 1, block.begin(), block.end());
+        EXPECT_TRUE(equal(as, 0, 1, 2, 3, 0));
+        as.modify(AtomIntVector::ModifyType::EraseRange, 0, EraseCount{2});
+        EXPECT_TRUE(equal(as, 2, 3, 0));
+        as.modify(AtomIntVector::ModifyType::AssignRange, 1, block.begin(), block.begin() + 2);
+        EXPECT_TRUE(equal(as, 2, 1, 2));
+    }
+    as.endTransaction();
+    EXPECT_EQ(as.get().size(), 3);
+
+    as.undo();
+    EXPECT_EQ(as.get().size(), 2);
+    EXPECT_TRUE(equal(as, 0, 0));
+    as.redo();
+    EXPECT_EQ(as.get().size(), 3);
+    EXPECT_TRUE(equal(as, 2, 1, 2));
+}
+
+TEST(AtomIntVector, RangeOutOfBoundsFails)
+{
+    AtomIntVector as(2, 0);
+    std::vector<int> block{1, 2, 3};
+    as.beginTransaction();
+    {
+        as.modify(AtomIntVector::ModifyType::InsertRange, 3, block.begin(), block.end());
+        as.modify(AtomIntVector::ModifyType::EraseRange, 1, EraseCount{2});
+        as.modify(AtomIntVector::ModifyType::AssignRange, 0, block.begin(), block.end());
+        as.modify(AtomIntVector::ModifyType::Modify, 2, 1);
+    }
+    as.endTransaction();
+    EXPECT_EQ(as.get().size(), 2);
+    EXPECT_TRUE(equal(as, 0, 0));
+    as.undo();
+    EXPECT_TRUE(equal(as, 0, 0));
+}
+
+TEST(AtomIntVector, SingleRecordsCarryNoRange)
+{
+    // 单个元素的记录只比旧值多一个指针
+    static_assert(sizeof(AtomIntVector::ModifyRecord) <= 3 * sizeof(size_t));
+    AtomIntVector as(4, 0);
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Modify, 0, 1);
+    as.modify(AtomIntVector::ModifyType::EraseRange, 1, EraseCount{2});
+    // EraseCount只能配EraseRange
+    as.modify(AtomIntVector::ModifyType::Erase, 0, EraseCount{1});
+    as.endTransaction();
+    EXPECT_TRUE(equal(as, 1, 0));
+
+    auto &records = as.root_.undoStack_.back()->modifyRecords_;
+    ASSERT_GE(records.size(), 2u);
+    EXPECT_TRUE(std::all_of(records.begin() + 2, records.end(),
+                            [](auto &rec) { return rec.type_ == AtomIntVector::ModifyType::Fail; }));
+    EXPECT_FALSE(records[0].range_);
+    ASSERT_TRUE(records[1].range_);
+    EXPECT_EQ(records[1].range_->values_, std::vector<int>({0, 0}));
+    as.undo();
+    EXPECT_TRUE(equal(as, 0, 0, 0, 0));
+}
+
+TEST(AtomIntVector, CoalesceAcrossInsertErase)
+{
+    AtomIntVector as(4, 0);
+    as.setCoalescePolicy(AtomIntVector::CoalescePolicy::records);
+    as.beginTransaction();
+    {
+        as.modify(AtomIntVector::ModifyType::Modify, 2, 1);
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 7);
+        as.modify(AtomIntVector::ModifyType::Modify, 3, 2);
+        as.modify(AtomIntVector::ModifyType::Modify, 0, 8);
+        as.modify(AtomIntVector::ModifyType::Erase, 1);
+        as.modify(AtomIntVector::ModifyType::Modify, 2, 3);
+    }
+    as.endTransaction();
+    EXPECT_EQ(as.get(), std::vector<int>({8, 0, 3, 0}));
+    EXPECT_EQ(as.root_.commits_.back()->modifyRecords_.size(), 3);
+
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>(4, 0));
+    as.redo();
+    EXPECT_EQ(as.get(), std::vector<int>({8, 0, 3, 0}));
+}
+
+TEST(AtomIntVector, CoalesceRandomEdits)
+{
+    std::mt19937 rng(42);
+    for (int round = 0; round < 50; ++round)
+    {
+        AtomIntVector as(8, 0);
+        as.setCoalescePolicy(AtomIntVector::CoalescePolicy::recordsAndChildren);
+        as.beginTransaction();
+        size_t depth = 1;
+        for (int i = 0; i < 200; ++i)
+        {
+            if (rng() % 16 == 0)
+            {
+                as.beginTransaction();
+                depth++;
+            }
+            if (rng() % 16 == 0 && depth > 1)
+            {
+                as.endTransaction();
+                depth--;
+                if (rng() % 2)
+                    as.undo();
+                if (rng() % 2)
+                    as.redo();
+            }
+
+            size_t size = as.get().size();
+            switch (rng() % 4)
+            {
+            case 0:
+                as.modify(AtomIntVector::ModifyType::Insert, rng() % (size + 1), i);
+                break;
+            case 1:
+                if (size)
+                    as.modify(AtomIntVector::ModifyType::Erase, rng() % size);
+                break;
+            default:
+                if (size)
+                    as.modify(AtomIntVector::ModifyType::Modify, rng() % size, i);
+                break;
+            }
+        }
+        while (as.inTransaction())
+            as.endTransaction();
+
+        std::vector<int> committed = as.get();
+        as.undo();
+        EXPECT_EQ(as.get(), std::vector<int>(8, 0));
+        as.redo();
+        EXPECT_EQ(as.get(), committed);
+    }
+}
+TEST(AtomIntVector, CheckpointResetToNested)
+{
+    AtomIntVector as(4, 0);
+    AtomIntVector::CheckpointPolicy policy;
+    policy.everyBytes_ = 256;
+    as.setCheckpointPolicy(policy);
+
+    std::vector<size_t> ids;
+    std::vector<std::vector<int>> values;
+    for (int i = 1; i <= 40; ++i)
+    {
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, i % 3, i);
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Modify, 0, -i);
+        as.endTransaction();
+        if (i % 4 == 0)
+        {
+            std::vector<int> block(i % 5, i);
+            as.modify(AtomIntVector::ModifyType::InsertRange, 1, block.begin(), block.end());
+            as.modify(AtomIntVector::ModifyType::EraseRange, 2, EraseCount{1});
+        }
+        ids.push_back(as.endTransaction());
+        values.push_back(as.get());
+    }
+    EXPECT_FALSE(as.checkpoints().empty());
+
+    for (int i : {37, 30, 29, 12, 0})
+    {
+        ASSERT_TRUE(as.resetTo(ids[i]));
+        EXPECT_EQ(as.get(), values[i]);
+    }
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>(4, 0));
+}
+
+TEST(AtomIntVector, SnapshotSharesChunks)
+{
+    AtomIntVector as(100000, 0);
+    as.enableSnapshots(4);
+    auto first = as.snapshot();
+    ASSERT_TRUE(first);
+    EXPECT_TRUE(first->value_ == as.get());
+
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Modify, 50000, 1);
+    as.modify(AtomIntVector::ModifyType::Insert, 50010, 2);
+    EXPECT_EQ(as.snapshot(), first);
+    size_t id = as.endTransaction();
+
+    auto second = as.snapshot();
+    EXPECT_EQ(second->id_, id);
+    EXPECT_TRUE(second->value_ == as.get());
+    EXPECT_EQ(second->value_[50000], 1);
+    EXPECT_EQ(first->value_[50000], 0);
+
+    size_t shared = 0;
+    auto &chunks = second->value_.chunks();
+    for (auto &&chunk : first->value_.chunks())
+        shared += std::find(chunks.begin(), chunks.end(), chunk) != chunks.end();
+    EXPECT_GE(shared + 2, first->value_.chunks().size());
+
+    as.undo();
+    EXPECT_TRUE(as.snapshot()->value_ == std::vector<int>(100000, 0));
+    EXPECT_EQ(as.getAt(id), second);
+    EXPECT_FALSE(as.getAt(id + 100));
+}
+
+TEST(AtomIntVector, SnapshotRandomEdits)
+{
+    AtomIntVector as(10, 0);
+    as.enableSnapshots();
+    std::mt19937 rng(7);
+    for (int i = 0; i < 2000; ++i)
+    {
+        as.beginTransaction();
+        size_t size = as.get().size();
+        switch (rng() % 5)
+        {
+        case 0:
+            as.modify(AtomIntVector::ModifyType::Insert, rng() % (size + 1), i);
+            break;
+        case 1:
+            as.modify(AtomIntVector::ModifyType::Erase, rng() % (size + 1));
+            break;
+        case 2: {
+            std::vector<int> block(rng() % 300, i);
+            as.modify(AtomIntVector::ModifyType::InsertRange, rng() % (size + 1), block.begin(), block.end());
+            break;
+        }
+        case 3:
+            as.modify(AtomIntVector::ModifyType::EraseRange, size / 2, EraseCount{rng() % (size / 2 + 1)});
+            break;
+        default:
+            as.modify(AtomIntVector::ModifyType::Modify, rng() % (size + 1), i);
+            break;
+        }
+        as.endTransaction();
+        if (rng() % 4 == 0)
+            as.undo();
+        ASSERT_TRUE(as.snapshot()->value_ == as.get()) << i;
+    }
+}
+
+TEST(AtomIntVector, SnapshotConcurrentReaders)
+{
+    AtomIntVector as(4096, 0);
+    as.enableSnapshots();
+    std::atomic<bool> done = false;
+    std::atomic<bool> consistent = true;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&]() {
+            while (!done.load())
+            {
+                // 一个事务把所有元素改成同一个值, 读到的版本里不能有两种值
+                auto version = as.snapshot();
+                int first = version->value_[0];
+                for (size_t index = 0; index < version->value_.size(); index += 97)
+                    consistent = consistent && version->value_[index] == first;
+            }
+        });
+    }
+
+    std::vector<int> block(4096);
+    for (int i = 1; i <= 500; ++i)
+    {
+        as.beginTransaction();
+        std::fill(block.begin(), block.end(), i);
+        as.modify(AtomIntVector::ModifyType::AssignRange, 0, block.begin(), block.begin() + 2048);
+        as.modify(AtomIntVector::ModifyType::AssignRange, 2048, block.begin() + 2048, block.end());
+        as.endTransaction();
+    }
+    done = true;
+    for (auto &&reader : readers)
+        reader.join();
+    EXPECT_TRUE(consistent);
+    EXPECT_EQ(as.snapshot()->value_[4095], 500);
+}
+
+TEST(AtomIntVector, CompactColdHistory)
+{
+    auto run = [](bool compact) {
+        AtomIntVector as(std::vector<int>(1000, 0));
+        if (compact)
+            as.setCompactPolicy({4});
+        std::vector<std::vector<int>> history{as.get()};
+        std::mt19937 rng(17);
+        for (int i = 0; i < 300; ++i)
+        {
+            as.beginTransaction();
+            for (int n = 0; n < 40; ++n)
+            {
+                size_t offset = 100 + rng() % 800;
+                switch (rng() % 3)
+                {
+                case 0:
+                    as.modify(AtomIntVector::ModifyType::Insert, offset, i);
+                    break;
+                case 1:
+                    as.modify(AtomIntVector::ModifyType::Erase, offset);
+                    break;
+                default:
+                    as.modify(AtomIntVector::ModifyType::EraseRange, offset, EraseCount{3});
+                    break;
+                }
+            }
+            // 子事务也一起打包
+            as.beginTransaction();
+            as.modify(AtomIntVector::ModifyType::Modify, 100 + rng() % 800, -i);
+            as.endTransaction();
+            as.endTransaction();
+            history.push_back(as.get());
+            if (i % 50 == 49)
+            {
+                // 冷commit解码之后undo/redo
+                for (int n = 0; n < 20; ++n)
+                    as.undo();
+                EXPECT_EQ(as.get(), history[history.size() - 21]);
+                for (int n = 0; n < 20; ++n)
+                    as.redo();
+                EXPECT_EQ(as.get(), history.back());
+            }
+        }
+        size_t bytes = as.historyBytes();
+        while (history.size() > 1)
+        {
+            as.undo();
+            history.pop_back();
+            EXPECT_EQ(as.get(), history.back());
+        }
+        return bytes;
+    };
+    size_t plain = run(false);
+    size_t compact = run(true);
+    EXPECT_LT(compact * 2, plain);
+}
+
+TEST(AtomIntVector, CheckoutNetDiff)
+{
+    AtomIntVector as(100, 0);
+    std::vector<size_t> ids;
+    std::vector<std::vector<int>> values;
+    std::mt19937 rng(23);
+    for (int i = 1; i <= 200; ++i)
+    {
+        as.beginTransaction();
+        for (int n = 0; n < 5; ++n)
+        {
+            size_t offset = rng() % as.get().size();
+            if (rng() % 4 == 0)
+                as.modify(AtomIntVector::ModifyType::Insert, offset, i);
+            else
+                as.modify(AtomIntVector::ModifyType::Modify, offset, i);
+        }
+        ids.push_back(as.endTransaction());
+        values.push_back(as.get());
+    }
+
+    size_t commits = as.root_.undoStack_.size();
+    size_t id = as.checkout(ids[9]);
+    ASSERT_NE(id, AtomIntVector::EmptyTransaction);
+    EXPECT_EQ(as.get(), values[9]);
+    EXPECT_EQ(as.root_.undoStack_.size(), commits + 1);
+    // 被改过很多次的元素只剩一条记录, 插入的元素还要一条一条删
+    EXPECT_LT(as.root_.undoStack_.back()->modifyRecords_.size(), 190 * 5 * 2 / 3);
+
+    as.undo();
+    EXPECT_EQ(as.get(), values.back());
+    as.redo();
+    EXPECT_EQ(as.get(), values[9]);
+
+    EXPECT_EQ(as.checkout(id), AtomIntVector::EmptyTransaction);
+    EXPECT_NE(as.checkout(ids[150]), AtomIntVector::EmptyTransaction);
+    EXPECT_EQ(as.get(), values[150]);
+    EXPECT_EQ(as.checkout(ids.size() + 1000), AtomIntVector::EmptyTransaction);
+    as.undo();
+    as.undo();
+    EXPECT_EQ(as.get(), values.back());
+}
+
+TEST(AtomVector, MoveOnlyElements)
+{
+    typedef TransInterface<std::vector<std::unique_ptr<int>>> Atom;
+    auto values = [](const Atom &as) {
+        std::vector<int> out;
+        for (auto &&e : as.get())
+            out.push_back(e ? *e : -1);
+        return out;
+    };
+
+    Atom as;
+    as.beginTransaction();
+    as.modify(Atom::ModifyType::Insert, 0, std::make_unique<int>(1));
+    as.modify(Atom::ModifyType::Insert, 1, std::make_unique<int>(2));
+    as.endTransaction();
+
+    std::vector<std::unique_ptr<int>> block;
+    block.push_back(std::make_unique<int>(7));
+    block.push_back(std::make_unique<int>(8));
+    as.beginTransaction();
+    as.modify(Atom::ModifyType::Modify, 0, std::make_unique<int>(3));
+    as.modify(Atom::ModifyType::InsertRange, 1, std::make_move_iterator(block.begin()),
+              std::make_move_iterator(block.end()));
+    as.beginTransaction();
+    as.modify(Atom::ModifyType::Erase, 3);
+    as.modify(Atom::ModifyType::EraseRange, 0, EraseCount{1});
+    as.endTransaction();
+    as.endTransaction();
+    EXPECT_EQ(values(as), std::vector<int>({7, 8}));
+
+    as.undo();
+    EXPECT_EQ(values(as), std::vector<int>({1, 2}));
+    as.redo();
+    EXPECT_EQ(values(as), std::vector<int>({7, 8}));
+    as.undo();
+    as.undo();
+    EXPECT_TRUE(as.get().empty());
+    as.redo();
+    as.redo();
+    EXPECT_EQ(values(as), std::vector<int>({7, 8}));
+}
+
+// 只能数拷贝, 移动不算
+struct CopyCounted
+{
+    static inline int copies_ = 0;
+
+    CopyCounted(int val = 0) : val_(val)
+    {
+    }
+
+    CopyCounted(const CopyCounted &rhs) : val_(rhs.val_)
+    {
+        ++copies_;
+    }
+
+    CopyCounted(CopyCounted &&) = default;
+
+    CopyCounted &operator=(const CopyCounted &rhs)
+    {
+        ++copies_;
+        val_ = rhs.val_;
+        return *this;
+    }
+
+    CopyCounted &operator=(CopyCounted &&) = default;
+
+    bool operator==(const CopyCounted &) const = default;
+
+    friend std::ostream &operator<<(std::ostream &os, const CopyCounted &val)
+    {
+        return os << val.val_;
+    }
+
+    int val_;
+};
+
+TEST(AtomVector, NoCopiesOnModifyUndoRedo)
+{
+    typedef TransInterface<std::vector<CopyCounted>> Atom;
+    Atom as(std::vector<CopyCounted>(4));
+    CopyCounted::copies_ = 0;
+    for (int i = 1; i <= 8; ++i)
+    {
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Modify, i % 4, CopyCounted(i));
+        as.modify(Atom::ModifyType::Insert, 0, CopyCounted(-i));
+        as.modify(Atom::ModifyType::Erase, 1);
+        as.endTransaction();
+    }
+    for (int i = 0; i < 8; ++i)
+        as.undo();
+    EXPECT_EQ(as.get(), std::vector<CopyCounted>(4));
+    for (int i = 0; i < 8; ++i)
+        as.redo();
+    EXPECT_EQ(as.get().front(), CopyCounted(-8));
+    EXPECT_EQ(CopyCounted::copies_, 0);
+}
+
+// 撤销过的子事务折叠进父事务时不算, 撤销又重做的按重做的时间算
+TEST(AtomIntVector, FoldUndoneChildren)
+{
+    AtomIntVector as(std::vector<int>{0});
+    as.setCoalescePolicy(AtomIntVector::CoalescePolicy::recordsAndChildren);
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 1);
+        as.endTransaction();
+        as.undo();
+
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 2);
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 3);
+        as.endTransaction();
+        as.undo();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 4);
+        as.redo();
+    }
+    as.endTransaction();
+    EXPECT_EQ(as.get(), std::vector<int>({3, 4, 2, 0}));
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_.size(), 3);
+
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>({0}));
+    as.redo();
+    EXPECT_EQ(as.get(), std::vector<int>({3, 4, 2, 0}));
+}
+
+TEST(AtomIntVector, AbortTransaction)
+{
+    AtomIntVector as(std::vector<int>{0, 0});
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Modify, 0, 1);
+    size_t first = as.endTransaction();
+    size_t bytes = as.historyBytes();
+    size_t live = as.historyStats().liveCommits_;
+
+    as.beginTransaction();
+    {
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 5);
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Modify, 1, 7);
+        as.endTransaction();
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Erase, 0);
+        as.endTransaction();
+        as.undo();
+        as.modify(AtomIntVector::ModifyType::Modify, 2, 9);
+        EXPECT_EQ(as.get(), std::vector<int>({5, 7, 9}));
+
+        // 只放弃最里面一层
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 8);
+        as.modify(AtomIntVector::ModifyType::EraseRange, 1, EraseCount{2});
+        EXPECT_TRUE(as.abortTransaction());
+        EXPECT_EQ(as.get(), std::vector<int>({5, 7, 9}));
+        EXPECT_EQ(as.historyStats().undoDepths_, (std::vector<size_t>{1, 1}));
+        EXPECT_EQ(as.historyStats().redoDepths_, (std::vector<size_t>{0, 1}));
+    }
+    EXPECT_TRUE(as.abortTransaction());
+    EXPECT_FALSE(as.abortTransaction());
+    EXPECT_EQ(as.get(), std::vector<int>({1, 0}));
+    EXPECT_EQ(as.historyBytes(), bytes);
+    EXPECT_EQ(as.historyStats().liveCommits_, live);
+    EXPECT_EQ(as.historyStats().undoDepths_, (std::vector<size_t>{1}));
+
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Modify, 1, 2);
+    EXPECT_EQ(as.endTransaction(), first + 1);
+    as.undo();
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>({0, 0}));
+    as.redo();
+    as.redo();
+    EXPECT_EQ(as.get(), std::vector<int>({1, 2}));
+}
+
+// 子事务被undo之后它的记录在undo commit里, abort时整个跳过; 它下面的mark_也不能再用
+TEST(AtomVector, AbortAfterNestedUndo)
+{
+    typedef TransInterface<std::vector<std::string>> Atom;
+    Atom as(std::vector<std::string>{"a", "b"});
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        for (int i = 0; i < 5; ++i)
+            as.modify(Atom::ModifyType::Modify, 0, std::to_string(i));
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Modify, 1, "x");
+        as.endTransaction();
+        as.endTransaction();
+        as.undo();
+        EXPECT_EQ(as.get(), std::vector<std::string>({"a", "b"}));
+
+        as.modify(Atom::ModifyType::Modify, 1, "y");
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Insert, 0, "z");
+        as.endTransaction();
+        as.undo();
+        as.redo();
+        EXPECT_EQ(as.get(), std::vector<std::string>({"z", "a", "y"}));
+    }
+    EXPECT_TRUE(as.abortTransaction());
+    EXPECT_EQ(as.get(), std::vector<std::string>({"a", "b"}));
+}
+
+TEST(AtomVector, AbortAfterCoalesce)
+{
+    typedef TransInterface<std::vector<std::string>> Atom;
+    Atom as(std::vector<std::string>{"a", "b"});
+    as.setCoalescePolicy(Atom::CoalescePolicy::records);
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        for (int i = 0; i < 5; ++i)
+            as.modify(Atom::ModifyType::Modify, 0, std::to_string(i));
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Modify, 1, "x");
+        as.endTransaction();
+        as.modify(Atom::ModifyType::Modify, 1, "y");
+        as.modify(Atom::ModifyType::Modify, 1, "z");
+        as.endTransaction();
+        EXPECT_EQ(as.root_.commits_.back()->children_.undoStack_.back()->modifyRecords_.size(), 6);
+
+        as.beginTransaction();
+        as.modify(Atom::ModifyType::Insert, 0, "w");
+        as.endTransaction();
+        as.undo();
+        EXPECT_EQ(as.get(), std::vector<std::string>({"4", "z"}));
+    }
+    EXPECT_TRUE(as.abortTransaction());
+    EXPECT_EQ(as.get(), std::vector<std::string>({"a", "b"}));
+}
+
+// 事务里先undo子事务再改外层, abort要连undo一起按时间倒回去
+TEST(AtomIntVector, AbortAfterUndoInterleaved)
+{
+    AtomIntVector as(std::vector<int>{1, 2});
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 7);
+        as.endTransaction();
+    }
+    as.modify(AtomIntVector::ModifyType::Modify, 2, 5);
+    as.undo();
+    EXPECT_TRUE(equal(as.get(), 1, 5));
+    EXPECT_TRUE(as.abortTransaction());
+    EXPECT_TRUE(equal(as.get(), 1, 2));
+}
+
+TEST(AtomIntVector, UndoRedoAfterUndoInterleaved)
+{
+    AtomIntVector as(std::vector<int>{1, 2});
+    as.beginTransaction();
+    {
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 7);
+        as.endTransaction();
+    }
+    as.modify(AtomIntVector::ModifyType::Modify, 2, 5);
+    as.undo();
+    as.endTransaction();
+    EXPECT_TRUE(equal(as.get(), 1, 5));
+
+    for (int round = 0; round < 2; ++round)
+    {
+        as.undo();
+        EXPECT_TRUE(equal(as.get(), 1, 2));
+        as.redo();
+        EXPECT_TRUE(equal(as.get(), 1, 5));
+    }
+}
+
+// 随机嵌套事务里穿插undo/redo: 每层abort回到该层begin时的值, 提交后undo/redo来回不变
+TEST(AtomIntVector, RandomNestedUndoRedo)
+{
+    std::mt19937 rng(7);
+    for (int round = 0; round < 200; ++round)
+    {
+        AtomIntVector as(4, 0);
+        std::vector<std::vector<int>> begins{as.get()};
+        as.beginTransaction();
+        for (int i = 1; i <= 40; ++i)
+        {
+            switch (rng() % 6)
+            {
+            case 0:
+                begins.push_back(as.get());
+                as.beginTransaction();
+                break;
+            case 1:
+                if (begins.size() > 1)
+                {
+                    as.endTransaction();
+                    begins.pop_back();
+                }
+                break;
+            case 2:
+                if (begins.size() > 1)
+                {
+                    EXPECT_TRUE(as.abortTransaction());
+                    EXPECT_EQ(as.get(), begins.back());
+                    begins.pop_back();
+                }
+                break;
+            case 3:
+                as.undo();
+                break;
+            case 4:
+                as.redo();
+                break;
+            default:
+                as.modify(AtomIntVector::ModifyType::Modify, rng() % 4, i);
+                break;
+            }
+        }
+        for (; begins.size() > 1; begins.pop_back())
+            as.endTransaction();
+        if (round % 2)
+        {
+            EXPECT_TRUE(as.abortTransaction());
+            EXPECT_EQ(as.get(), begins[0]);
+            continue;
+        }
+        as.endTransaction();
+        std::vector<int> committed = as.get();
+        for (int n = 0; n < 2; ++n)
+        {
+            as.undo();
+            EXPECT_EQ(as.get(), begins[0]);
+            as.redo();
+            EXPECT_EQ(as.get(), committed);
+        }
+    }
+}
+
+TEST(MismatchBytes, AllImplementationsAgree)
+{
+    std::mt19937 rng(7);
+    for (size_t size : {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 200, 1000})
+    {
+        std::vector<char> a(size);
+        for (auto &c : a)
+            c = static_cast<char>(rng());
+        for (size_t pos = 0; pos <= size; ++pos)
+        {
+            std::vector<char> b = a;
+            if (pos < size)
+                b[pos] ^= static_cast<char>(1 + rng() % 255);
+            EXPECT_EQ(mismatchBytesScalar(a.data(), b.data(), size), pos);
+            EXPECT_EQ(mismatchBytes(a.data(), b.data(), size), pos);
+#ifdef SIMD_DIFF_X86
+            EXPECT_EQ(mismatchBytesSse2(a.data(), b.data(), size), pos);
+            if (__builtin_cpu_supports("avx2"))
+            {
+                EXPECT_EQ(mismatchBytesAvx2(a.data(), b.data(), size), pos);
+            }
+#endif
+        }
+    }
+}
+
+TEST(AtomIntVector, AssignDiff)
+{
+    std::vector<int> base(100000);
+    std::iota(base.begin(), base.end(), 0);
+    AtomIntVector as(base);
+
+    // 1%分散的修改, 一整段, 以及隔得很近会合并的两处
+    std::vector<int> next = base;
+    for (size_t i = 0; i < next.size(); i += 100)
+        next[i] = -1;
+    for (size_t i = 5001; i < 5051; ++i)
+        next[i] = -2;
+    next[7001] = next[7003] = -3;
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Assign, next);
+    as.endTransaction();
+    EXPECT_EQ(as.get(), next);
+
+    auto &records = as.root_.undoStack_.back()->modifyRecords_;
+    EXPECT_EQ(records.size(), 1000u);
+    for (auto &&rec : records)
+        EXPECT_EQ(rec.type_, AtomIntVector::ModifyType::AssignRange);
+    EXPECT_LT(as.historyBytes(), base.size() * sizeof(int) / 5);
+
+    as.undo();
+    EXPECT_EQ(as.get(), base);
+    as.redo();
+    EXPECT_EQ(as.get(), next);
+
+    // 长度变化在末尾
+    std::vector<int> longer = next;
+    longer.insert(longer.end(), {1, 2, 3});
+    longer[3] = 9;
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Assign, std::move(longer));
+    as.endTransaction();
+    EXPECT_EQ(as.get().size(), next.size() + 3);
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_.back().type_, AtomIntVector::ModifyType::InsertRange);
+
+    std::vector<int> shorter(next.begin(), next.begin() + 10);
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Assign, shorter);
+    as.endTransaction();
+    EXPECT_EQ(as.get(), shorter);
+    EXPECT_EQ(as.root_.undoStack_.back()->modifyRecords_.size(), 2u);
+
+    as.beginTransaction();
+    as.modify(AtomIntVector::ModifyType::Assign, shorter);
+    as.endTransaction();
+    EXPECT_TRUE(as.root_.undoStack_.back()->modifyRecords_.empty());
+
+    as.undo();
+    as.undo();
+    as.undo();
+    EXPECT_EQ(as.get(), next);
+    as.undo();
+    EXPECT_EQ(as.get(), base);
+}
+
+TEST(AtomVector, AssignDiffStrings)
+{
+    typedef TransInterface<std::vector<std::string>> Atom;
+    Atom as(std::vector<std::string>{"a", "b", "c", "d"});
+    std::vector<std::string> next{"a", "x", "c", "d", "e"};
+    as.beginTransaction();
+    as.modify(Atom::ModifyType::Assign, next);
+    as.endTransaction();
+    EXPECT_EQ(as.get(), next);
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<std::string>({"a", "b", "c", "d"}));
+    as.redo();
+    EXPECT_EQ(as.get(), next);
+}
@@ -0,0 +1,84 @@
+#include "atom.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(ConcurrentIntegral, CommitAndConflict)
+{
+    ConcurrentInt as(0);
+    auto tx1 = as.beginTransaction();
+    auto tx2 = as.beginTransaction();
+    EXPECT_EQ(as.endTransaction(tx1), ConcurrentInt::EmptyTransaction);
+
+    tx1.modify(ConcurrentInt::ModifyType::modify, 1);
+    tx1.modify(ConcurrentInt::ModifyType::modify, tx1.get() + 1);
+    size_t id = as.endTransaction(tx1);
+    EXPECT_EQ(id, 0);
+    EXPECT_TRUE(as.get() == 2);
+
+    // tx2看到的还是0
+    tx2.modify(ConcurrentInt::ModifyType::modify, tx2.get() + 10);
+    EXPECT_EQ(as.endTransaction(tx2), ConcurrentInt::Conflict);
+    EXPECT_TRUE(as.get() == 2);
+    EXPECT_TRUE(tx2.base() == 2);
+    tx2.modify(ConcurrentInt::ModifyType::modify, tx2.get() + 10);
+    EXPECT_EQ(as.endTransaction(tx2), 1);
+    EXPECT_TRUE(as.get() == 12);
+    EXPECT_EQ(as.conflicts(), 1);
+}
+
+TEST(ConcurrentIntegral, UndoRedo)
+{
+    ConcurrentInt as(0);
+    size_t first = as.transact([](auto &tx) { tx.modify(ConcurrentInt::ModifyType::modify, 5); });
+    size_t second = as.transact([](auto &tx) { tx.modify(ConcurrentInt::ModifyType::modify, tx.get() * 2); });
+    EXPECT_TRUE(as.get() == 10);
+
+    // first之后值又被改过
+    EXPECT_EQ(as.undo(first), ConcurrentInt::Conflict);
+    size_t undoSecond = as.undo(second);
+    ASSERT_NE(undoSecond, ConcurrentInt::Conflict);
+    EXPECT_TRUE(as.get() == 5);
+    EXPECT_EQ(as.undo(second), ConcurrentInt::Conflict);
+
+    size_t redoSecond = as.undo(undoSecond);
+    ASSERT_NE(redoSecond, ConcurrentInt::Conflict);
+    EXPECT_TRUE(as.get() == 10);
+    EXPECT_NE(as.undo(redoSecond), ConcurrentInt::Conflict);
+    EXPECT_NE(as.undo(first), ConcurrentInt::Conflict);
+    EXPECT_TRUE(as.get() == 0);
+}
+
+TEST(ConcurrentIntegral, HistoryIsBounded)
+{
+    ConcurrentInt as(0, 8);
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 20; ++i)
+        ids.push_back(as.transact([i](auto &tx) { tx.modify(ConcurrentInt::ModifyType::modify, i); }));
+    EXPECT_EQ(as.undo(ids[19]), 20);
+    EXPECT_TRUE(as.get() == 19);
+    EXPECT_EQ(as.undo(ids[10]), ConcurrentInt::Conflict);
+}
+
+TEST(ConcurrentIntegral, ConcurrentIncrements)
+{
+    ConcurrentInt as(0, 64);
+    const int threads = 8;
+    const int increments = 20000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < increments; ++i)
+            {
+                size_t id = as.transact([](auto &tx) { tx.modify(ConcurrentInt::ModifyType::modify, tx.get() + 1); });
+                // 偶尔撤销自己刚提交的, 冲突时这次就算了
+                if (i % 100 == 0 && as.undo(id) != ConcurrentInt::Conflict)
+                    as.transact([](auto &tx) { tx.modify(ConcurrentInt::ModifyType::modify, tx.get() + 1); });
+            }
+        });
+    }
+    for (auto &&worker : workers)
+        worker.join();
+    EXPECT_TRUE(as.get() == threads * increments);
+}
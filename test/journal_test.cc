@@ -0,0 +1,455 @@
+#include "atom.h"
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class JournalTest : public testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        path_ = testing::TempDir() + "journal_test_" + std::to_string(::getpid()) + ".txj";
+        std::remove(path_.c_str());
+        std::remove((path_ + ".snap").c_str());
+    }
+
+    void TearDown() override
+    {
+        std::remove(path_.c_str());
+        std::remove((path_ + ".snap").c_str());
+    }
+
+    std::string path_;
+};
+
+TEST_F(JournalTest, ReplayValueAndHistory)
+{
+    {
+        AtomIntVector as(2, 0);
+        ASSERT_TRUE(as.openJournal(path_));
+        as.beginTransaction();
+        {
+            as.modify(AtomIntVector::ModifyType::Insert, 0, 1);
+            as.beginTransaction();
+            as.modify(AtomIntVector::ModifyType::Modify, 2, 5);
+            as.endTransaction();
+            as.undo();
+            as.redo();
+        }
+        as.endTransaction();
+
+        std::vector<int> block{7, 8, 9};
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::InsertRange, 1, block.begin(), block.end());
+        as.modify(AtomIntVector::ModifyType::EraseRange, 0, EraseCount{1});
+        as.endTransaction();
+        as.undo();
+        as.redo();
+        as.undo();
+        EXPECT_EQ(as.get(), std::vector<int>({1, 0, 5}));
+    }
+
+    AtomIntVector as(2, 0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_EQ(as.get(), std::vector<int>({1, 0, 5}));
+    as.redo();
+    EXPECT_EQ(as.get(), std::vector<int>({7, 8, 9, 0, 5}));
+    as.undo();
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>({0, 0}));
+}
+
+TEST_F(JournalTest, OpenTransactionIsNotDurable)
+{
+    {
+        AtomInt as(0);
+        ASSERT_TRUE(as.openJournal(path_));
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 1);
+        as.endTransaction();
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 2);
+    }
+
+    AtomInt as(0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_TRUE(as.get() == 1);
+    as.undo();
+    EXPECT_TRUE(as.get() == 0);
+}
+
+TEST_F(JournalTest, TornTailIsTruncated)
+{
+    {
+        AtomInt as(0);
+        ASSERT_TRUE(as.openJournal(path_));
+        for (int i = 1; i <= 3; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomInt::ModifyType::modify, i);
+            as.endTransaction();
+        }
+    }
+    {
+        std::ofstream ofs(path_, std::ios::binary | std::ios::app);
+        const char torn[] = "\x10\x00\x00\x00\x01\x02\x03\x04garbage";
+        ofs.write(torn, sizeof(torn) - 1);
+    }
+
+    {
+        AtomInt as(0);
+        ASSERT_TRUE(as.openJournal(path_));
+        EXPECT_TRUE(as.get() == 3);
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 4);
+        as.endTransaction();
+    }
+
+    AtomInt as(0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_TRUE(as.get() == 4);
+}
+
+// 文件大小限制让write只写进去一部分: 半帧被截掉, 之后的append都失败
+TEST_F(JournalTest, ShortWriteIsTruncatedAndLatched)
+{
+    Journal journal;
+    ASSERT_TRUE(journal.open(path_));
+    ASSERT_TRUE(journal.append("first"));
+    uint64_t size = journal.size();
+
+    struct rlimit old;
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &old), 0);
+    auto handler = ::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = old;
+    limit.rlim_cur = size + 16;
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limit), 0);
+    bool ok = journal.append(std::string(1000, 'x'));
+    ::setrlimit(RLIMIT_FSIZE, &old);
+    ::signal(SIGXFSZ, handler);
+
+    EXPECT_FALSE(ok);
+    EXPECT_TRUE(journal.failed());
+    EXPECT_FALSE(journal.append("second"));
+    EXPECT_FALSE(journal.sync());
+    struct stat st;
+    ASSERT_EQ(::stat(path_.c_str(), &st), 0);
+    EXPECT_EQ(static_cast<uint64_t>(st.st_size), size);
+
+    Journal reopened;
+    ASSERT_TRUE(reopened.open(path_));
+    std::vector<std::string> frames;
+    EXPECT_TRUE(reopened.replay([&](ByteReader &reader) {
+        std::string payload(reader.remaining(), '\0');
+        reader.getBytes(payload.data(), payload.size());
+        frames.push_back(payload);
+        return true;
+    }));
+    EXPECT_EQ(frames, std::vector<std::string>{"first"});
+}
+
+TEST_F(JournalTest, SnapshotSkipsOlderFrames)
+{
+    AtomIntVector::CheckpointPolicy policy;
+    policy.everyCommits_ = 2;
+    {
+        AtomIntVector as(1, 0);
+        as.setCheckpointPolicy(policy);
+        ASSERT_TRUE(as.openJournal(path_));
+        for (int i = 1; i <= 5; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomIntVector::ModifyType::Insert, 0, i);
+            as.endTransaction();
+        }
+        EXPECT_FALSE(as.journalError());
+    }
+
+    {
+        AtomIntVector as(1, 0);
+        ASSERT_TRUE(as.openJournal(path_));
+        EXPECT_EQ(as.get(), std::vector<int>({5, 4, 3, 2, 1, 0}));
+        // snapshot之前的历史不在了
+        as.undo();
+        EXPECT_EQ(as.get(), std::vector<int>({4, 3, 2, 1, 0}));
+        as.undo();
+        EXPECT_EQ(as.get(), std::vector<int>({4, 3, 2, 1, 0}));
+    }
+
+    JournalOptions options;
+    options.snapshots_ = false;
+    AtomIntVector as(1, 0);
+    ASSERT_TRUE(as.openJournal(path_, options));
+    EXPECT_EQ(as.get(), std::vector<int>({4, 3, 2, 1, 0}));
+    as.undo();
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>({2, 1, 0}));
+}
+
+TEST_F(JournalTest, SnapshotFallsBackToFullReplay)
+{
+    AtomInt::CheckpointPolicy policy;
+    policy.everyCommits_ = 4;
+    {
+        AtomInt as(0);
+        as.setCheckpointPolicy(policy);
+        ASSERT_TRUE(as.openJournal(path_));
+        for (int i = 1; i <= 4; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomInt::ModifyType::modify, i);
+            as.endTransaction();
+        }
+        // snapshot之后的undo引用了snapshot之前的commit
+        as.undo();
+        as.undo();
+        EXPECT_TRUE(as.get() == 2);
+    }
+
+    AtomInt as(0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_TRUE(as.get() == 2);
+    as.undo();
+    EXPECT_TRUE(as.get() == 1);
+    as.redo();
+    as.redo();
+    as.redo();
+    EXPECT_TRUE(as.get() == 4);
+}
+
+TEST_F(JournalTest, ReplayResetTo)
+{
+    {
+        AtomInt as(0);
+        ASSERT_TRUE(as.openJournal(path_));
+        std::vector<size_t> ids;
+        for (int i = 1; i <= 4; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomInt::ModifyType::modify, i);
+            ids.push_back(as.endTransaction());
+        }
+        ASSERT_TRUE(as.resetTo(ids[1]));
+        as.beginTransaction();
+        as.modify(AtomInt::ModifyType::modify, 10);
+        as.endTransaction();
+    }
+
+    AtomInt as(0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_TRUE(as.get() == 10);
+    as.undo();
+    EXPECT_TRUE(as.get() == 2);
+    as.undo();
+    EXPECT_TRUE(as.get() == 1);
+}
+
+TEST_F(JournalTest, ReplayCheckout)
+{
+    std::vector<size_t> ids;
+    {
+        AtomIntVector as(4, 0);
+        ASSERT_TRUE(as.openJournal(path_));
+        for (int i = 1; i <= 4; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomIntVector::ModifyType::Insert, 0, i);
+            as.modify(AtomIntVector::ModifyType::Modify, 4, i);
+            ids.push_back(as.endTransaction());
+        }
+        ASSERT_NE(as.checkout(ids[0]), AtomIntVector::EmptyTransaction);
+    }
+
+    AtomIntVector as(4, 0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_EQ(as.get(), std::vector<int>({1, 0, 0, 0, 1}));
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>({4, 3, 2, 1, 4, 3, 2, 1}));
+    EXPECT_NE(as.checkout(ids[2]), AtomIntVector::EmptyTransaction);
+    EXPECT_EQ(as.get(), std::vector<int>({3, 2, 1, 0, 3, 2, 1}));
+}
+
+TEST_F(JournalTest, AsyncGroupCommit)
+{
+    JournalOptions options;
+    options.async_ = true;
+    options.groupCommitMicros_ = 200;
+    {
+        AtomIntVector as(0, 0);
+        ASSERT_TRUE(as.openJournal(path_, options));
+        int durableCallbacks = 0;
+        for (int i = 0; i < 3000; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomIntVector::ModifyType::Insert, 0, i);
+            as.endTransaction();
+            if (i % 1000 == 0)
+                as.whenDurable([&](bool ok) { durableCallbacks += ok; });
+        }
+        as.undo();
+        auto durable = as.durable();
+        EXPECT_TRUE(durable.get());
+        EXPECT_EQ(durableCallbacks, 3);
+        EXPECT_FALSE(as.journalError());
+
+        // close时把队列里剩下的帧写完
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, -1);
+        as.endTransaction();
+    }
+
+    AtomIntVector as(0, 0);
+    ASSERT_TRUE(as.openJournal(path_));
+    ASSERT_EQ(as.get().size(), 3000u);
+    EXPECT_EQ(as.get().front(), -1);
+    EXPECT_EQ(as.get().back(), 0);
+    as.undo();
+    EXPECT_EQ(as.get().front(), 2998);
+    as.redo();
+    EXPECT_EQ(as.get().front(), -1);
+}
+
+TEST_F(JournalTest, AsyncSnapshot)
+{
+    JournalOptions options;
+    options.async_ = true;
+    AtomIntVector::CheckpointPolicy policy;
+    policy.everyCommits_ = 100;
+    {
+        AtomIntVector as(1, 0);
+        as.setCheckpointPolicy(policy);
+        ASSERT_TRUE(as.openJournal(path_, options));
+        for (int i = 1; i <= 250; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomIntVector::ModifyType::Modify, 0, i);
+            as.endTransaction();
+        }
+        EXPECT_FALSE(as.journalError());
+    }
+
+    AtomIntVector as(1, 0);
+    ASSERT_TRUE(as.openJournal(path_, options));
+    EXPECT_EQ(as.get(), std::vector<int>({250}));
+    for (int i = 0; i < 60; ++i)
+        as.undo();
+    // snapshot在第200个commit, 之前的历史不在了
+    EXPECT_EQ(as.get(), std::vector<int>({200}));
+}
+
+TEST_F(JournalTest, ReplayAssign)
+{
+    std::vector<int> next(1000, 1);
+    next[10] = next[500] = 2;
+    next.push_back(3);
+    {
+        AtomIntVector as(1000, 1);
+        ASSERT_TRUE(as.openJournal(path_));
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Assign, next);
+        as.endTransaction();
+    }
+
+    AtomIntVector as(1000, 1);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_EQ(as.get(), next);
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>(1000, 1));
+}
+
+TEST_F(JournalTest, AbortedTransactionsLeaveNoFrames)
+{
+    {
+        AtomIntVector as(1, 0);
+        ASSERT_TRUE(as.openJournal(path_));
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 1);
+        as.endTransaction();
+
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 2);
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 3);
+        ASSERT_TRUE(as.abortTransaction());
+        as.modify(AtomIntVector::ModifyType::Modify, 0, 4);
+        as.endTransaction();
+
+        as.beginTransaction();
+        as.modify(AtomIntVector::ModifyType::Insert, 0, 5);
+        ASSERT_TRUE(as.abortTransaction());
+        EXPECT_FALSE(as.journalError());
+    }
+
+    AtomIntVector as(1, 0);
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_EQ(as.get(), std::vector<int>({4, 1, 0}));
+    as.undo();
+    EXPECT_EQ(as.get(), std::vector<int>({1, 0}));
+}
+
+TEST_F(JournalTest, ReplayArray)
+{
+    AtomIntArray<300>::CheckpointPolicy policy;
+    policy.everyCommits_ = 3;
+    {
+        AtomIntArray<300> as;
+        as.setCheckpointPolicy(policy);
+        ASSERT_TRUE(as.openJournal(path_));
+        for (int i = 1; i <= 4; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomIntArray<300>::ModifyType::Modify, 299, i);
+            as.modify(AtomIntArray<300>::ModifyType::Modify, i, i);
+            as.modify(AtomIntArray<300>::ModifyType::Modify, 299, -i);
+            as.endTransaction();
+        }
+        EXPECT_FALSE(as.journalError());
+    }
+
+    AtomIntArray<300> as;
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_EQ(as.get()[299], -4);
+    EXPECT_EQ(as.get()[4], 4);
+    as.undo();
+    EXPECT_EQ(as.get()[299], -3);
+    EXPECT_EQ(as.get()[4], 0);
+}
+
+TEST_F(JournalTest, ReplayByteBuffer)
+{
+    const size_t size = 3 * AtomInterface<ByteBuffer>::PageSize;
+    AtomByteBuffer::CheckpointPolicy policy;
+    policy.everyCommits_ = 3;
+    {
+        AtomByteBuffer as(ByteBuffer{size});
+        as.setCheckpointPolicy(policy);
+        ASSERT_TRUE(as.openJournal(path_));
+        for (int i = 1; i <= 4; ++i)
+        {
+            as.beginTransaction();
+            as.modify(AtomByteBuffer::ModifyType::Write, size - sizeof(int), i);
+            as.modify(AtomByteBuffer::ModifyType::Write, i * sizeof(int), i);
+            as.modify(AtomByteBuffer::ModifyType::Write, size - sizeof(int), -i);
+            as.endTransaction();
+        }
+        EXPECT_FALSE(as.journalError());
+    }
+
+    auto at = [&](const AtomByteBuffer &as, size_t offset) {
+        int val;
+        memcpy(&val, as.get().data() + offset, sizeof(val));
+        return val;
+    };
+    AtomByteBuffer as(ByteBuffer{size});
+    ASSERT_TRUE(as.openJournal(path_));
+    EXPECT_EQ(at(as, size - sizeof(int)), -4);
+    EXPECT_EQ(at(as, 4 * sizeof(int)), 4);
+    as.undo();
+    EXPECT_EQ(at(as, size - sizeof(int)), -3);
+    EXPECT_EQ(at(as, 4 * sizeof(int)), 0);
+}
@@ -0,0 +1,206 @@
+#include "atom.h"
+#include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+typedef ShardedIntVector::ModifyType ModifyType;
+
+static int sum(const ShardedIntVector &as)
+{
+    int total = 0;
+    for (size_t shard = 0; shard < as.shardCount(); ++shard)
+    {
+        std::vector<int> val = as.get(shard);
+        total = std::accumulate(val.begin(), val.end(), total);
+    }
+    return total;
+}
+
+TEST(ShardedVector, CommitAndAbort)
+{
+    ShardedIntVector as(3, 4);
+    auto tx = as.beginTransaction({2, 0});
+    EXPECT_TRUE(tx.modify(0, ModifyType::Modify, 1, 10));
+    EXPECT_TRUE(tx.modify(2, ModifyType::Insert, 0, 20));
+    EXPECT_FALSE(tx.modify(1, ModifyType::Modify, 0, 30));
+    EXPECT_EQ(tx.get(2), std::vector<int>({20, 0, 0, 0, 0}));
+    EXPECT_EQ(as.endTransaction(tx), 0);
+    EXPECT_FALSE(tx.active());
+    EXPECT_EQ(as.get(0), std::vector<int>({0, 10, 0, 0}));
+    EXPECT_EQ(as.get(1), std::vector<int>(4));
+
+    // 只读的分片不留commit, 一个都没改时没有id
+    auto readOnly = as.beginTransaction(1);
+    EXPECT_EQ(as.endTransaction(readOnly), ShardedIntVector::EmptyTransaction);
+
+    {
+        auto aborted = as.beginTransaction({0, 1});
+        aborted.modify(0, ModifyType::Modify, 1, 11);
+        aborted.modify(1, ModifyType::Erase, 0);
+    }
+    EXPECT_EQ(as.get(0), std::vector<int>({0, 10, 0, 0}));
+    EXPECT_EQ(as.get(1), std::vector<int>(4));
+    EXPECT_EQ(as.transact({1}, [](auto &tx) { tx.modify(1, ModifyType::Modify, 3, 1); }), 1);
+}
+
+TEST(ShardedVector, UndoRedoAcrossShards)
+{
+    ShardedIntVector as(2, 2);
+    size_t both = as.transact({0, 1}, [](auto &tx) {
+        tx.modify(0, ModifyType::Modify, 0, 1);
+        tx.modify(1, ModifyType::Modify, 0, 1);
+    });
+    size_t second = as.transact({1}, [](auto &tx) { tx.modify(1, ModifyType::Modify, 1, 2); });
+
+    // 分片1在both之后又提交过
+    EXPECT_FALSE(as.undo(both));
+    EXPECT_EQ(as.get(0), std::vector<int>({1, 0}));
+    EXPECT_TRUE(as.undo(second));
+    EXPECT_FALSE(as.undo(second));
+    EXPECT_TRUE(as.undo(both));
+    EXPECT_EQ(as.get(0), std::vector<int>({0, 0}));
+    EXPECT_EQ(as.get(1), std::vector<int>({0, 0}));
+
+    EXPECT_FALSE(as.redo(second));
+    EXPECT_TRUE(as.redo(both));
+    EXPECT_EQ(as.get(1), std::vector<int>({1, 0}));
+    EXPECT_TRUE(as.undo(both));
+
+    // 分片0上有了新的提交, 跨分片的both不能只redo一半
+    as.transact({0}, [](auto &tx) { tx.modify(0, ModifyType::Modify, 1, 5); });
+    EXPECT_FALSE(as.redo(both));
+    EXPECT_EQ(as.get(1), std::vector<int>({0, 0}));
+}
+
+TEST(ShardedVector, Retention)
+{
+    ShardedIntVector as(2, 1);
+    as.setRetentionPolicy({2});
+    size_t both = as.transact({0, 1}, [](auto &tx) {
+        tx.modify(0, ModifyType::Modify, 0, 1);
+        tx.modify(1, ModifyType::Modify, 0, 1);
+    });
+    std::vector<size_t> ids;
+    for (int i = 2; i <= 3; ++i)
+        ids.push_back(as.transact({0}, [i](auto &tx) { tx.modify(0, ModifyType::Modify, 0, i); }));
+
+    // both在分片0上已经被挤出历史, 分片1还能undo也不行
+    EXPECT_TRUE(as.undo(ids[1]));
+    EXPECT_TRUE(as.undo(ids[0]));
+    EXPECT_FALSE(as.undo(both));
+    EXPECT_EQ(as.get(0), std::vector<int>{1});
+    EXPECT_EQ(as.get(1), std::vector<int>{1});
+}
+
+// 没生效的修改不算改过分片: 只有Fail的分片abort掉, 不占id
+TEST(ShardedVector, FailedModifyAbortsShard)
+{
+    ShardedIntVector as(2, 2);
+    auto failed = as.beginTransaction({0, 1});
+    EXPECT_FALSE(failed.modify(0, ModifyType::Erase, 5));
+    EXPECT_FALSE(failed.modify(1, ModifyType::Modify, 2, 1));
+    EXPECT_EQ(as.endTransaction(failed), ShardedIntVector::EmptyTransaction);
+
+    size_t id = as.transact({0, 1}, [](auto &tx) {
+        EXPECT_FALSE(tx.modify(0, ModifyType::Erase, 5));
+        EXPECT_TRUE(tx.modify(1, ModifyType::Modify, 0, 1));
+    });
+    EXPECT_EQ(id, 1);
+    EXPECT_TRUE(as.undo(id));
+    EXPECT_EQ(as.get(1), std::vector<int>({0, 0}));
+    // 分片0上没有留下commit, 不会挡住只在分片0上的undo
+    size_t only = as.transact({0}, [](auto &tx) { tx.modify(0, ModifyType::Modify, 1, 2); });
+    EXPECT_TRUE(as.undo(only));
+    EXPECT_EQ(as.get(0), std::vector<int>({0, 0}));
+}
+
+// retention把redo栈里的commit挤掉之后就不能再redo
+TEST(ShardedVector, RetentionEvictsRedo)
+{
+    // 一个commit刚好放得下, undo之后加上undo commit就超了
+    AtomIntVector probe(std::vector<int>(1));
+    probe.beginTransaction();
+    probe.modify(AtomIntVector::ModifyType::Modify, 0, 1);
+    probe.endTransaction();
+    ShardedIntVector::ShardType::RetentionPolicy policy;
+    policy.maxHistoryBytes_ = probe.historyBytes();
+
+    ShardedIntVector as(1, 1);
+    as.setRetentionPolicy(policy);
+    size_t id = as.transact({0}, [](auto &tx) { tx.modify(0, ModifyType::Modify, 0, 1); });
+    EXPECT_TRUE(as.undo(id));
+    EXPECT_FALSE(as.redo(id));
+    EXPECT_EQ(as.get(0), std::vector<int>{0});
+
+    // 新的提交也清空redo
+    as.setRetentionPolicy({});
+    size_t next = as.transact({0}, [](auto &tx) { tx.modify(0, ModifyType::Modify, 0, 2); });
+    EXPECT_TRUE(as.undo(next));
+    as.transact({0}, [](auto &tx) { tx.modify(0, ModifyType::Modify, 0, 3); });
+    EXPECT_FALSE(as.redo(next));
+    EXPECT_EQ(as.get(0), std::vector<int>{3});
+}
+
+TEST(ShardedVector, ParallelDisjointWriters)
+{
+    const size_t threads = 4;
+    const int rounds = 2000;
+    ShardedIntVector as(threads, 16);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&as, t] {
+            for (int i = 0; i < rounds; ++i)
+            {
+                auto tx = as.beginTransaction(t);
+                tx.modify(t, ModifyType::Modify, i % 16, tx.get(t)[i % 16] + 1);
+                as.endTransaction(tx);
+            }
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    for (size_t t = 0; t < threads; ++t)
+        EXPECT_EQ(as.get(t), std::vector<int>(16, rounds / 16));
+}
+
+// 跨分片转账, 任何时候看到的总数都不变
+TEST(ShardedVector, CrossShardTransfers)
+{
+    const size_t shards = 4;
+    ShardedIntVector as(shards, 8, 100);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < 4; ++t)
+    {
+        workers.emplace_back([&as, t] {
+            std::mt19937 rng(t);
+            for (int i = 0; i < 1000; ++i)
+            {
+                size_t from = rng() % shards;
+                size_t to = rng() % shards;
+                size_t a = rng() % 8;
+                size_t b = rng() % 8;
+                as.transact({from, to}, [&](auto &tx) {
+                    tx.modify(from, ModifyType::Modify, a, tx.get(from)[a] - 1);
+                    tx.modify(to, ModifyType::Modify, b, tx.get(to)[b] + 1);
+                });
+            }
+        });
+    }
+    std::thread reader([&as] {
+        for (int i = 0; i < 200; ++i)
+        {
+            auto tx = as.beginTransaction({0, 1, 2, 3});
+            int total = 0;
+            for (size_t shard = 0; shard < shards; ++shard)
+                total = std::accumulate(tx.get(shard).begin(), tx.get(shard).end(), total);
+            EXPECT_EQ(total, 3200);
+        }
+    });
+    for (auto &worker : workers)
+        worker.join();
+    reader.join();
+    EXPECT_EQ(sum(as), 3200);
+}
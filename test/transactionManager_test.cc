@@ -0,0 +1,122 @@
+#include "atom.h"
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+typedef TransactionManager<int, std::vector<int>, long> Manager;
+
+TEST(TransactionManager, UndoRedoAcrossAtoms)
+{
+    Manager mgr(0, std::vector<int>(2, 0), 100);
+    mgr.beginTransaction();
+    mgr.modify<0>(AtomInt::ModifyType::modify, 1);
+    mgr.modify<1>(AtomIntVector::ModifyType::Insert, 0, 7);
+    mgr.modify<2>(Manager::ModifyTypeOf<2>::modify, 200);
+    mgr.endTransaction();
+    EXPECT_EQ(mgr.get<0>(), 1);
+    EXPECT_EQ(mgr.get<1>(), std::vector<int>({7, 0, 0}));
+    EXPECT_EQ(mgr.get<2>(), 200);
+
+    mgr.undo();
+    EXPECT_EQ(mgr.get(), std::make_tuple(0, std::vector<int>(2, 0), 100L));
+    mgr.redo();
+    EXPECT_EQ(mgr.get(), std::make_tuple(1, std::vector<int>({7, 0, 0}), 200L));
+}
+
+TEST(TransactionManager, NestedAndCoalesce)
+{
+    Manager mgr(0, std::vector<int>(2, 0), 0);
+    mgr.setCoalescePolicy(Manager::CoalescePolicy::recordsAndChildren);
+    mgr.beginTransaction();
+    for (int i = 1; i <= 10; ++i)
+    {
+        mgr.modify<0>(AtomInt::ModifyType::modify, i);
+        mgr.beginTransaction();
+        mgr.modify<1>(AtomIntVector::ModifyType::Modify, 1, i);
+        mgr.modify<2>(Manager::ModifyTypeOf<2>::modify, -i);
+        mgr.endTransaction();
+    }
+    mgr.endTransaction();
+
+    // 每个成员合并成一条
+    ASSERT_EQ(mgr.root_.undoStack_.back()->modifyRecords_.size(), 3);
+    EXPECT_TRUE(mgr.root_.undoStack_.back()->children_.commits_.empty());
+    mgr.undo();
+    EXPECT_EQ(mgr.get(), std::make_tuple(0, std::vector<int>(2, 0), 0L));
+    mgr.redo();
+    EXPECT_EQ(mgr.get(), std::make_tuple(10, std::vector<int>({0, 10}), -10L));
+}
+
+TEST(TransactionManager, SnapshotAndCheckpoint)
+{
+    Manager mgr(0, std::vector<int>(), 0);
+    mgr.enableSnapshots();
+    Manager::CheckpointPolicy policy;
+    policy.everyCommits_ = 3;
+    mgr.setCheckpointPolicy(policy);
+
+    std::vector<size_t> ids;
+    for (int i = 1; i <= 10; ++i)
+    {
+        mgr.beginTransaction();
+        mgr.modify<0>(AtomInt::ModifyType::modify, i);
+        mgr.modify<1>(AtomIntVector::ModifyType::Insert, 0, i);
+        ids.push_back(mgr.endTransaction());
+        mgr.beginTransaction();
+        mgr.modify<2>(Manager::ModifyTypeOf<2>::modify, i);
+        EXPECT_EQ(std::get<2>(mgr.snapshot()->value_), i - 1);
+        mgr.endTransaction();
+    }
+    EXPECT_EQ(std::get<1>(mgr.snapshot()->value_).size(), 10);
+
+    ASSERT_TRUE(mgr.resetTo(ids[4]));
+    EXPECT_EQ(mgr.get(), std::make_tuple(5, std::vector<int>({5, 4, 3, 2, 1}), 4L));
+    EXPECT_EQ(std::get<0>(mgr.snapshot()->value_), 5);
+}
+
+TEST(TransactionManager, JournalReplay)
+{
+    std::string path = testing::TempDir() + "transaction_manager_test_" + std::to_string(::getpid()) + ".txj";
+    std::remove(path.c_str());
+    {
+        Manager mgr(0, std::vector<int>(1, 0), 0);
+        ASSERT_TRUE(mgr.openJournal(path));
+        mgr.beginTransaction();
+        mgr.modify<0>(AtomInt::ModifyType::modify, 3);
+        std::vector<int> block{1, 2, 3};
+        mgr.modify<1>(AtomIntVector::ModifyType::InsertRange, 1, block.begin(), block.end());
+        mgr.endTransaction();
+        mgr.beginTransaction();
+        mgr.modify<2>(Manager::ModifyTypeOf<2>::modify, 9);
+        mgr.endTransaction();
+        mgr.undo();
+    }
+
+    Manager mgr(0, std::vector<int>(1, 0), 0);
+    ASSERT_TRUE(mgr.openJournal(path));
+    EXPECT_EQ(mgr.get(), std::make_tuple(3, std::vector<int>({0, 1, 2, 3}), 0L));
+    mgr.redo();
+    EXPECT_EQ(mgr.get<2>(), 9);
+    std::remove(path.c_str());
+}
+
+TEST(TransactionManager, ByteBufferMember)
+{
+    typedef TransactionManager<int, ByteBuffer> BufferManager;
+    BufferManager mgr(0, ByteBuffer{64});
+    mgr.setCoalescePolicy(BufferManager::CoalescePolicy::records);
+    mgr.beginTransaction();
+    mgr.modify<0>(AtomInt::ModifyType::modify, 1);
+    mgr.modify<1>(AtomByteBuffer::ModifyType::Write, 0, 7);
+    mgr.modify<1>(AtomByteBuffer::ModifyType::Write, 8, 7);
+    mgr.endTransaction();
+
+    // 事务边界转给了ByteBuffer成员, 同一页只存一次
+    EXPECT_EQ(mgr.root_.undoStack_.back()->modifyRecords_.size(), 2);
+    EXPECT_EQ(mgr.get<1>().data()[8], std::byte{7});
+    mgr.undo();
+    EXPECT_EQ(mgr.get(), std::make_tuple(0, ByteBuffer{64}));
+    mgr.redo();
+    EXPECT_EQ(mgr.get<0>(), 1);
+    EXPECT_EQ(mgr.get<1>().data()[0], std::byte{7});
+}